@@ -4,7 +4,13 @@
 */
 
 #include "enbaya.h"
+#include <float.h>
 #include <stdio.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
 
 typedef struct {
     int32_t sample;
@@ -19,22 +25,112 @@ typedef struct {
     float_t duration;
     float_t quantization_error;
     int32_t sample_rate;
+    int32_t num_rotation_flips;
+    uint32_t signature;
+    uint32_t restart_interval;
+    float_t rotation_quantization_error[300];
+    float_t translation_quantization_error[300];
+    uint8_t dropped_component[300];
+    uint16_t predictor[300];
     quat_trans_int* track_data[300];
     int32_t num_track_data_samples[300];
 } enb_plain_animation;
 
 typedef struct {
-    int32_t value;
-    bool has_value;
-} enb_anim_value;
+    int32_t* value[7];
+    uint8_t* has_value;
+} enb_anim_tracks;
+
+#define ENB_RESAMPLE_BATCH 0x10
+#define ENB_MATRIX_BATCH 0x10
+#define ENB_FLIP_BATCH 0x40
+
+#define ENB_DROPPED_COMPONENT_SET 0x04
+#define ENB_DROPPED_COMPONENT_NEGATIVE 0x80
+#define ENB_DROPPED_COMPONENT_MIN 0.5f
+
+#define ENB_SIGNATURE_OPT_IN (ENB_SIGNATURE_SMALLEST_THREE | ENB_SIGNATURE_ENTROPY_CODED | ENB_SIGNATURE_PREDICTOR)
+#define ENB_SIGNATURE_BATCH_ONLY (ENB_SIGNATURE_SMALLEST_THREE | ENB_SIGNATURE_PREDICTOR)
+
+#define ENB_PREDICTOR_ORDER_2 0x00
+#define ENB_PREDICTOR_ORDER_1 0x01
+#define ENB_PREDICTOR_ORDER_0 0x02
+#define ENB_PREDICTOR_GET(predictor, comp) (((predictor) >> ((comp) * 2)) & 0x03)
+
+#define ENB_RANS_BLOCK 0x400
+#define ENB_RANS_VALUE_RANGE 0x1F
+#define ENB_RANS_ESCAPE_I8 (ENB_RANS_VALUE_RANGE * 2 + 1)
+#define ENB_RANS_ESCAPE_I16 (ENB_RANS_ESCAPE_I8 + 1)
+#define ENB_RANS_ESCAPE_I32 (ENB_RANS_ESCAPE_I8 + 2)
+#define ENB_RANS_SYMBOLS (ENB_RANS_ESCAPE_I8 + 3)
+#define ENB_RANS_SCALE_BITS 12
+#define ENB_RANS_SCALE (1 << ENB_RANS_SCALE_BITS)
+#define ENB_RANS_LOW (1U << 23)
 
 typedef struct {
-    enb_anim_value comp[7];
-} enb_anim_track_sample;
+    uint32_t symbol_count;
+    uint32_t data_length;
+    uint16_t freq[ENB_RANS_SYMBOLS];
+} enb_anim_rans_header;
 
 typedef struct {
-    enb_anim_track_sample* samples;
-} enb_anim_tracks;
+    uint32_t offset;
+    uint32_t i8;
+    uint32_t i16;
+    uint32_t i32;
+} enb_anim_rans_block;
+
+struct enb_anim_restart_header {
+    uint32_t interval;                                      // Point i restarts at sample (i + 1) * interval
+    uint32_t count;
+    uint32_t point_length;                                  // Bytes, point then 14 floats and flags per track
+};
+
+// Offsets are in bytes into the data sections, track i2 holds the rANS position when entropy coded
+typedef struct {
+    uint32_t track_offset[5];
+    uint32_t state_offset[4];
+    int32_t next_step;
+    int32_t prev_step;
+    int8_t i2_counter;
+    int8_t i4_counter;
+    int8_t u2_counter;
+    uint8_t padding;
+} enb_anim_restart_point;
+
+// Reads two steps behind a backward walk, order 0/1 components are undone from those residuals
+struct enb_anim_predictor_reader {
+    enb_anim_track_data_decoder track_data;
+    enb_anim_state_data_decoder state_data;
+    enb_anim_state state;
+    uint32_t rans_position;
+    int32_t sample;                                         // Holds the residuals of steps sample and sample - 1
+    enb_track* track;                                       // Flags only
+    int32_t* residual[2];                                   // 7 per track
+};
+
+struct enb_anim_rans_decoder {
+    const uint8_t* data;
+    const enb_anim_rans_block* blocks;
+    const int8_t* i8;
+    const int16_t* i16;
+    const int32_t* i32;
+    uint32_t symbol_count;
+    uint32_t position;
+    int32_t block;
+    uint16_t freq[ENB_RANS_SYMBOLS];
+    uint16_t start[ENB_RANS_SYMBOLS];
+    uint8_t slot[ENB_RANS_SCALE];
+    int32_t value[ENB_RANS_BLOCK];
+};
+
+typedef struct {
+    const quat_trans* track_data;
+    int32_t num_track_data_samples;
+    int32_t count;
+    int32_t* index;
+    float_t* blend;
+} enb_anim_resample_table;
 
 typedef struct {
     uint8_t* data;
@@ -46,13 +142,21 @@ typedef struct {
     enb_stream base;
 } enb_byte_stream;
 
+typedef struct enb_arena_block {
+    struct enb_arena_block* next;
+    size_t size;
+    size_t used;
+} enb_arena_block;
+
 typedef struct {
-    enb_byte_stream** stream_list;
-    int32_t stream_count;
-    uint32_t total_size;
+    enb_arena_block* block;
+} enb_arena;
+
+typedef struct {
+    enb_arena* arena;
     uint8_t* data;
     uint32_t size;
-    enb_byte_stream* byte_stream;
+    uint32_t capacity;
 } enb_octet_stream;
 
 typedef struct {
@@ -75,6 +179,7 @@ typedef struct {
     enb_octet_stream i8_stream;
     enb_octet_stream i16_stream;
     enb_octet_stream i32_stream;
+    uint32_t count;
 } enb_anim_track_stream;
 
 typedef struct {
@@ -84,13 +189,240 @@ typedef struct {
     enb_octet_stream u32_stream;
 } enb_anim_state_stream;
 
+#define ENB_ENCODE_WINDOW 0x10
+
+struct enb_encode_context {
+    enb_plain_animation plain_anim;
+    quat_trans_interp_method quat_method;
+    quat_trans_interp_method trans_method;
+    int32_t min_range_size;
+    int32_t num_frames;
+    int32_t next_sample;
+    int32_t num_samples;
+    int32_t num_written_samples;
+    int32_t pending_sample;
+    quat_trans* prev_frame;
+    quat_trans* last_frame;
+    quat_trans_int* data;
+    quat_trans_int* pending_data;
+    int32_t* prev_data;
+    int32_t* prev_delta;
+    int32_t* range_size;
+    bool* set_no_value;
+    int32_t* values;
+    bool* has_value;
+    bool* prev_has_value;
+    uint8_t* track_flags;
+    uint32_t step;
+    enb_arena arena;
+    enb_anim_track_init_stream track_data_init_stream;
+    enb_anim_track_stream track_data_stream;
+    enb_anim_state_stream state_data_stream;
+};
+
+#define ENB_MAX_THREADS 0x40
+#define ENB_VERIFY_MAX_THREADS ENB_MAX_THREADS
+#define ENB_DECODE_MAX_THREADS ENB_MAX_THREADS
+
+#ifdef _WIN32
+typedef LPTHREAD_START_ROUTINE enb_job_func;
+#else
+typedef void* (*enb_job_func)(void* arg);
+#endif
+
+typedef struct {
+    const quat_trans* track_data;
+    const int32_t* track_data_offset;
+    const int32_t* track_data_count;
+    const quat_trans* decoded;
+    int32_t num_tracks;
+    int32_t num_samples;
+    float_t seconds_per_sample;
+    float_t duration;
+    quat_trans_interp_method quat_method;
+    quat_trans_interp_method trans_method;
+    int32_t first_track;
+    int32_t track_step;
+    enb_track_error* track_error;
+} enb_verify_job;
+
+// Poses of a run of tracks laid out per component. The -Os build doesn't vectorize, the gain is blending
+// each component across the run with the method switch outside the track loop
+typedef struct {
+    float_t qx[ENB_MATRIX_BATCH];
+    float_t qy[ENB_MATRIX_BATCH];
+    float_t qz[ENB_MATRIX_BATCH];
+    float_t qw[ENB_MATRIX_BATCH];
+    float_t tx[ENB_MATRIX_BATCH];
+    float_t ty[ENB_MATRIX_BATCH];
+    float_t tz[ENB_MATRIX_BATCH];
+    float_t sx[ENB_MATRIX_BATCH];
+    float_t sy[ENB_MATRIX_BATCH];
+    float_t sz[ENB_MATRIX_BATCH];
+} enb_matrix_batch;
+
+typedef struct {
+    const enb_anim_context* source;
+    quat_trans* data_out;
+    uint32_t first_sample;
+    uint32_t last_sample;
+    int32_t result;
+} enb_decode_job;
+
+typedef struct {
+    enb_anim_context* anim_ctx;
+    const enb_baked_clip* baked;
+    uint8_t* data_out;                                      // Frame 0, quat_trans or enb_matrix3x4 rows
+    int32_t first_frame;
+    int32_t last_frame;
+    float_t fps;
+    float_t start;
+    const int32_t* tracks;
+    int32_t num_tracks;
+    int32_t output;
+    const vec3* scale;
+    quat_trans_interp_method quat_method;
+    quat_trans_interp_method trans_method;
+} enb_process_job;
+
+typedef struct {
+    float_t time;
+    int32_t index;
+} enb_time_query;
+
+typedef struct {
+    const enb_anim_stream* stream;
+    float_t time;
+    int32_t index;
+    size_t offset;
+} enb_instance_query;
+
+typedef struct enb_pose_cache_entry {
+    struct enb_pose_cache_entry* hash_next;
+    struct enb_pose_cache_entry* lru_prev;
+    struct enb_pose_cache_entry* lru_next;
+    const enb_anim_stream* stream;
+    uint32_t sample;
+    int32_t track_count;
+    quat_trans pose[];
+} enb_pose_cache_entry;
+
+struct enb_pose_cache {
+#ifdef _WIN32
+    CRITICAL_SECTION lock;
+#else
+    pthread_mutex_t lock;
+#endif
+    enb_pose_cache_entry** bucket;
+    uint32_t bucket_count;
+    enb_pose_cache_entry* lru_head;                         // Most recently used
+    enb_pose_cache_entry* lru_tail;
+    enb_pose_cache_stats stats;
+};
+
+typedef struct {
+    uint32_t generation;
+    uint32_t sample;
+} enb_prefetch_slot;
+
+struct enb_prefetch {
+    enb_anim_context* producer_ctx;                         // Worker thread only
+    enb_anim_context* consumer_ctx;                         // Synchronous fallback, caller thread only
+    int32_t track_count;
+    uint32_t capacity;
+    enb_prefetch_slot* slot;
+    quat_trans* pose;                                       // capacity * track_count
+    uint32_t head;                                          // Written by the worker
+    uint32_t tail;                                          // Written by the caller
+    uint32_t seek_generation;                               // Written by the caller
+    uint32_t seek_sample;                                   // Written by the caller
+    uint32_t generation;                                    // Caller side copy of seek_generation
+    uint32_t waiting;
+    uint32_t stop;
+#ifdef _WIN32
+    HANDLE thread;
+    CRITICAL_SECTION lock;
+    CONDITION_VARIABLE wake;
+#else
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+#endif
+};
+
+struct enb_baked_clip {
+    int32_t format;
+    int32_t track_count;
+    uint32_t sample_count;
+    int32_t column_count;
+    float_t duration;
+    float_t seconds_per_sample;
+    size_t pose_size;
+    size_t row_size;
+    size_t size;
+    int32_t* column;                                        // Per track column, or -1 - static pose index
+    quat_trans* static_pose;
+    vec3* trans_min;                                        // ENB_BAKE_INT16 only, per column
+    vec3* trans_scale;
+    uint8_t* table;                                         // ENB_BAKE_ALIGNMENT aligned rows of sample poses
+    uint8_t* table_data;
+};
+
+#define ENB_BAKE_ALIGNMENT 0x40
+
+#define ENB_POSE_CACHE_MIN_BUCKETS 0x10
+#define ENB_POSE_CACHE_MAX_BUCKETS 0x100000
+
 static void enb_get_track_data(enb_anim_context* anim_ctx, int32_t track_id,
     quat_trans** prev, quat_trans** next, float_t time);
 static quat_trans* enb_get_track_data_next(enb_anim_context* anim_ctx, int32_t track_id);
 static quat_trans* enb_get_track_data_prev(enb_anim_context* anim_ctx, int32_t track_id);
+static float_t enb_get_track_pair(enb_anim_context* anim_ctx, int32_t track_id, float_t time,
+    const quat_trans** prev, const quat_trans** next);
+static float_t enb_get_sample_interval(float_t prev_time, float_t seconds_per_sample, float_t duration);
 static void enb_init(enb_anim_context* anim_ctx, enb_anim_stream* anim_stream);
 static void enb_init_decoder(enb_anim_context* anim_ctx);
+static void enb_find_static_tracks(enb_anim_context* anim_ctx);
+static void enb_invalidate_time(enb_anim_context* anim_ctx);
+static int32_t enb_clone(const enb_anim_context* source, enb_anim_context** anim_ctx);
+static int enb_time_query_compare(const void* a, const void* b);
+static int enb_instance_query_compare(const void* a, const void* b);
+static uint32_t enb_find_sample(enb_anim_context* anim_ctx, float_t time, float_t* blend);
+static void enb_get_sample_pose(enb_anim_context* anim_ctx, bool next, quat_trans* pose);
+static void enb_blend_sample(enb_anim_context* anim_ctx, uint32_t sample, float_t blend,
+    quat_trans* data, quat_trans_interp_method quat_method, quat_trans_interp_method trans_method);
+static void enb_get_matrices_batch(enb_anim_context* anim_ctx, float_t time,
+    const int32_t* tracks, int32_t count, const vec3* scale, enb_matrix3x4* data,
+    quat_trans_interp_method quat_method, quat_trans_interp_method trans_method);
+static void enb_matrix_batch_put_scale(enb_matrix_batch* batch, int32_t index, const vec3* scale);
+static void enb_matrix_batch_convert(const enb_matrix_batch* batch, int32_t count, enb_matrix3x4* data);
+static void enb_process_frames(const enb_process_job* job);
+static void enb_process_matrices(const enb_process_job* job);
+static void enb_baked_put_pose(enb_baked_clip* baked, uint32_t sample, int32_t column, const quat_trans* pose);
+static void enb_baked_get_pose(const enb_baked_clip* baked, uint32_t sample, int32_t column, quat_trans* pose);
+static void enb_pose_cache_lock(enb_pose_cache* cache);
+#ifdef _WIN32
+static DWORD WINAPI enb_prefetch_thread(LPVOID arg);
+#else
+static void* enb_prefetch_thread(void* arg);
+#endif
+static bool enb_prefetch_can_produce(enb_prefetch* prefetch, uint32_t sample);
+static void enb_prefetch_notify(enb_prefetch* prefetch);
+static void enb_pose_cache_unlock(enb_pose_cache* cache);
+static enb_pose_cache_entry** enb_pose_cache_get_bucket(enb_pose_cache* cache,
+    const enb_anim_stream* stream, uint32_t sample);
+static enb_pose_cache_entry* enb_pose_cache_find(enb_pose_cache* cache,
+    const enb_anim_stream* stream, uint32_t sample);
+static void enb_pose_cache_insert(enb_pose_cache* cache, enb_anim_context* anim_ctx, uint32_t sample, bool next);
+static void enb_pose_cache_remove(enb_pose_cache* cache, enb_pose_cache_entry* entry);
+static void enb_pose_cache_touch(enb_pose_cache* cache, enb_pose_cache_entry* entry);
 static void enb_set_time(enb_anim_context* anim_ctx, float_t time);
+static void enb_set_sample(enb_anim_context* anim_ctx, uint32_t sample);
+static uint32_t enb_step_to_sample(enb_anim_context* anim_ctx, uint32_t sample, uint32_t max_steps);
+static float_t enb_get_quantization_error(enb_anim_context* anim_ctx);
+static void enb_reset_sample(enb_anim_context* anim_ctx, const float_t quantization_error);
+static void enb_sample_step_forward(enb_anim_context* anim_ctx, const float_t quantization_error);
+static void enb_sample_step_backward(enb_anim_context* anim_ctx, const float_t quantization_error);
 static void enb_track_init(enb_anim_context* anim_ctx,
     const int32_t track_count, enb_anim_track_data_init_decoder* track_data_init);
 static void enb_track_step_forward(enb_anim_context* anim_ctx,
@@ -113,6 +445,18 @@ inline static int32_t enb_anim_track_data_forward_decode(enb_anim_track_data_dec
 inline static int32_t enb_anim_track_data_backward_decode(enb_anim_track_data_decoder* track_data);
 inline static uint32_t enb_anim_state_data_forward_decode(enb_anim_state_data_decoder* state_data);
 inline static uint32_t enb_anim_state_data_backward_decode(enb_anim_state_data_decoder* state_data);
+inline static uint32_t enb_anim_restart_get_point_length(int32_t track_count);
+static int32_t enb_find_restart(enb_anim_context* anim_ctx, uint32_t sample);
+static void enb_restore_restart(enb_anim_context* anim_ctx, int32_t restart);
+static bool enb_anim_stream_add_restart_points(uint32_t interval, uint8_t** data_out, size_t* data_out_len);
+#ifdef _WIN32
+static DWORD WINAPI enb_decode_thread(LPVOID arg);
+static DWORD WINAPI enb_process_thread(LPVOID arg);
+#else
+static void* enb_decode_thread(void* arg);
+static void* enb_process_thread(void* arg);
+#endif
+static void enb_run_jobs(enb_job_func func, void* jobs, int32_t count, size_t stride);
 
 inline static uint8_t* enb_anim_stream_get_track_data_init_i2(enb_anim_stream* anim_stream);
 inline static uint8_t* enb_anim_stream_get_track_data_init_i8(enb_anim_stream* anim_stream);
@@ -128,32 +472,92 @@ inline static uint8_t* enb_anim_stream_get_state_data_u8(enb_anim_stream* anim_s
 inline static uint8_t* enb_anim_stream_get_state_data_u16(enb_anim_stream* anim_stream);
 inline static uint8_t* enb_anim_stream_get_state_data_u32(enb_anim_stream* anim_stream);
 inline static uint8_t* enb_anim_stream_get_track_flags(enb_anim_stream* anim_stream);
+inline static float_t* enb_anim_stream_get_quantization(enb_anim_stream* anim_stream);
+inline static uint32_t enb_anim_stream_get_quantization_length(enb_anim_stream* anim_stream);
+inline static uint8_t* enb_anim_stream_get_dropped_components(enb_anim_stream* anim_stream);
+inline static uint32_t enb_anim_stream_get_dropped_components_length(enb_anim_stream* anim_stream);
+inline static uint8_t* enb_anim_stream_get_entropy(enb_anim_stream* anim_stream);
+inline static uint32_t enb_anim_stream_get_entropy_length(enb_anim_stream* anim_stream);
+inline static uint16_t* enb_anim_stream_get_predictors(enb_anim_stream* anim_stream);
+inline static uint32_t enb_anim_stream_get_predictors_length(enb_anim_stream* anim_stream);
+inline static uint8_t* enb_anim_stream_get_restart(enb_anim_stream* anim_stream);
+inline static uint32_t enb_anim_stream_get_restart_length(enb_anim_stream* anim_stream);
+inline static void enb_quat_restore_component(quat* q, uint8_t dropped_component);
+inline static void enb_track_reset_predicted(enb_track* track, uint16_t predictor);
+inline static void enb_track_clear_order_0(quat* quat_data, vec3* trans_data, uint16_t predictor);
+static enb_anim_predictor_reader* enb_anim_predictor_reader_create(int32_t track_count);
+static void enb_anim_predictor_reader_step(enb_anim_context* anim_ctx, int32_t* residual);
+static void enb_track_undo_predicted(enb_anim_context* anim_ctx, const int32_t track_count);
+
+static bool enb_anim_rans_decoder_init(enb_anim_rans_decoder* rans, enb_anim_stream* anim_stream);
+static void enb_anim_rans_decoder_decode_block(enb_anim_rans_decoder* rans, int32_t block);
+inline static int32_t enb_anim_rans_decoder_forward(enb_anim_rans_decoder* rans);
+inline static int32_t enb_anim_rans_decoder_backward(enb_anim_rans_decoder* rans);
+static void enb_anim_rans_normalize_freq(const uint32_t* hist, uint32_t count, uint16_t* freq);
+static void enb_anim_rans_encode(const int32_t* values, uint32_t count, enb_byte_stream* byte_stream,
+    enb_byte_stream* i8_stream, enb_byte_stream* i16_stream, enb_byte_stream* i32_stream);
 inline static uint32_t enb_anim_stream_get_length(enb_anim_stream* anim_stream);
 
 static void enb_anim_stream_encoder_find_value_ranges(
-    enb_anim_track_sample* samples, int32_t size, int32_t min_range_size);
+    enb_anim_tracks* samples, int32_t size, int32_t min_range_size);
+static void enb_anim_tracks_get_has_value_bits(enb_anim_tracks* track_data,
+    int32_t num_tracks, int32_t sample, uint64_t* bits, int32_t num_words);
+inline static int32_t enb_ctz64(uint64_t value);
+
+static void enb_anim_stream_encoder_output(enb_anim_track_init_stream* track_data_init_stream,
+    enb_anim_track_stream* track_data_stream, enb_anim_state_stream* state_data_stream,
+    enb_byte_stream* track_flags_byte_stream, int32_t num_tracks, float_t duration,
+    const enb_plain_animation* plain_anim, uint8_t** data_out, size_t* data_out_len);
+
+static void enb_encode_context_resample(enb_encode_context* enc_ctx,
+    const quat_trans* prev, const quat_trans* next, float_t time, quat_trans_int* dst);
+static void enb_encode_context_put_sample(enb_encode_context* enc_ctx, const quat_trans_int* data);
+static void enb_encode_context_drop_range(enb_encode_context* enc_ctx, int32_t comp, int32_t sample, int32_t size);
+static void enb_encode_context_write_sample(enb_encode_context* enc_ctx, int32_t sample);
+
+static void enb_verify_track(enb_verify_job* job, int32_t track_id, quat_trans* keys);
+#ifdef _WIN32
+static DWORD WINAPI enb_verify_thread(LPVOID arg);
+#else
+static void* enb_verify_thread(void* arg);
+#endif
 
 static void enb_plain_anim_init(enb_plain_animation* plain_anim);
+static void enb_plain_anim_set_quantization(enb_plain_animation* plain_anim,
+    int32_t num_tracks, const enb_encode_options* options);
 static void enb_plain_anim_prepare_data(enb_plain_animation* plain_anim, quat_trans* track_data,
     int32_t* track_data_count, int32_t num_tracks, int32_t num_components, float_t duration, int32_t sample_rate,
-    float_t quantization_error, quat_trans_interp_method quat_method, quat_trans_interp_method trans_method);
-static void enb_plain_anim_flip_rotation(enb_plain_animation* plain_anim, quat_trans** track_data);
-static void enb_anim_track_data_flip_rotation(quat_trans* track_data, int32_t count);
+    const enb_encode_options* options, quat_trans_interp_method quat_method, quat_trans_interp_method trans_method);
+static int32_t enb_plain_anim_flip_rotation(enb_plain_animation* plain_anim, quat_trans** track_data);
+static int32_t enb_anim_track_data_flip_rotation(quat_trans* track_data, int32_t count);
+static bool enb_anim_track_data_flip_rotation_pair(const quat_trans* prev, quat_trans* data);
 static void enb_plain_anim_get_animation_data(enb_plain_animation* plain_anim,
     quat_trans** track_data, quat_trans_interp_method quat_method, quat_trans_interp_method trans_method);
 static void enb_plain_anim_get_track_data(enb_plain_animation* plain_anim,
     quat_trans* track_data, int32_t* num_track_data_samples, int32_t track_id,
+    enb_anim_resample_table* table, quat_trans_interp_method quat_method, quat_trans_interp_method trans_method);
+static bool enb_anim_resample_table_init(enb_anim_resample_table* table,
+    const quat_trans* track_data, int32_t num_track_data_samples, int32_t count, float_t seconds_per_sample);
+static void enb_anim_resample_table_free(enb_anim_resample_table* table);
+static void enb_anim_track_data_interp_batch(const quat_trans** prev, const quat_trans** next,
+    const float_t* blend, quat_trans* curr, int32_t count,
     quat_trans_interp_method quat_method, quat_trans_interp_method trans_method);
-static void enb_plain_anim_get_data(enb_plain_animation* plain_anim, quat_trans_int* dst, quat_trans* src);
+static void enb_plain_anim_get_data(enb_plain_animation* plain_anim,
+    quat_trans_int* dst, quat_trans* src, int32_t track_id);
+static void enb_plain_anim_get_data_batch(enb_plain_animation* plain_anim, quat_trans_int* dst,
+    const quat_trans* src, int32_t count, int32_t track_id, int32_t track_step);
 static int32_t enb_plain_anim_get_largest_track_id(enb_plain_animation* plain_anim);
 static int32_t enb_plain_anim_get_num_track_data_samples(enb_plain_animation* plain_anim, int32_t track_id);
 static void enb_plain_anim_get_samples(
-    enb_plain_animation* plain_anim, int32_t track_id, enb_anim_track_sample* samples);
+    enb_plain_animation* plain_anim, int32_t track_id, enb_anim_tracks* samples);
+static void enb_plain_anim_drop_component(
+    enb_plain_animation* plain_anim, int32_t track_id, enb_anim_tracks* samples);
+static int32_t enb_plain_anim_select_predictor(const quat_trans_int* data, int32_t count, int32_t comp);
+inline static uint32_t enb_anim_residual_cost(int32_t value);
 static quat_trans_int* enb_plain_anim_get_track_data_sample(
     enb_plain_animation* plain_anim, int32_t track_id, int32_t sample);
 static void enb_plain_anim_write_data(enb_plain_animation* plain_anim, int32_t num_tracks,
-    int32_t num_components, float_t duration, int32_t sample_rate, float_t quantization_error,
-    uint8_t** data_out, size_t* data_out_len);
+    int32_t num_components, float_t duration, uint8_t** data_out, size_t* data_out_len);
 static void enb_plain_anim_free(enb_plain_animation* plain_anim);
 
 static void enb_stream_init(enb_stream* stream);
@@ -168,40 +572,48 @@ static void enb_byte_stream_free(enb_byte_stream* byte_stream);
 static void enb_byte_stream_set_data(enb_byte_stream* byte_stream, uint8_t* value);
 static void enb_byte_stream_set_size(enb_byte_stream* byte_stream, size_t value);
 
-static void enb_octet_stream_alloc(enb_octet_stream* octet_stream);
+static void enb_arena_init(enb_arena* arena);
+static uint8_t* enb_arena_alloc(enb_arena* arena, size_t size);
+static bool enb_arena_extend(enb_arena* arena, uint8_t* data, size_t size, size_t new_size);
+static void enb_arena_free(enb_arena* arena);
+
+static bool enb_octet_stream_grow(enb_octet_stream* octet_stream, size_t size);
 static void enb_octet_stream_copy_to_byte_stream(enb_octet_stream* octet_stream, enb_byte_stream* byte_stream);
-static void enb_octet_stream_init(enb_octet_stream* octet_stream);
-static void enb_octet_stream_put_i8(enb_octet_stream* octet_stream, int8_t value);
-static void enb_octet_stream_put_u8(enb_octet_stream* octet_stream, uint8_t value);
-static void enb_octet_stream_put_i16(enb_octet_stream* octet_stream, int16_t value);
-static void enb_octet_stream_put_u16(enb_octet_stream* octet_stream, uint16_t value);
-static void enb_octet_stream_put_i32(enb_octet_stream* octet_stream, int32_t value);
-static void enb_octet_stream_put_u32(enb_octet_stream* octet_stream, uint32_t value);
-static void enb_octet_stream_reset(enb_octet_stream* octet_stream);
+static void enb_octet_stream_init(enb_octet_stream* octet_stream, enb_arena* arena);
+inline static void enb_octet_stream_put_i8(enb_octet_stream* octet_stream, int8_t value);
+inline static void enb_octet_stream_put_u8(enb_octet_stream* octet_stream, uint8_t value);
+inline static void enb_octet_stream_put_i16(enb_octet_stream* octet_stream, int16_t value);
+inline static void enb_octet_stream_put_u16(enb_octet_stream* octet_stream, uint16_t value);
+inline static void enb_octet_stream_put_i32(enb_octet_stream* octet_stream, int32_t value);
+inline static void enb_octet_stream_put_u32(enb_octet_stream* octet_stream, uint32_t value);
+static uint8_t* enb_octet_stream_put_span(enb_octet_stream* octet_stream, size_t size);
 static void enb_octet_stream_free(enb_octet_stream* octet_stream);
 
-static void enb_bit_octet_stream_init(enb_bit_octet_stream* bit_octet_stream);
+static void enb_bit_octet_stream_init(enb_bit_octet_stream* bit_octet_stream, enb_arena* arena);
 static void enb_bit_octet_stream_copy_to_byte_stream(
     enb_bit_octet_stream* bit_octet_stream, enb_byte_stream* byte_stream);
 static void enb_bit_octet_stream_put_u2(enb_bit_octet_stream* bit_octet_stream, uint8_t value);
 static void enb_bit_octet_stream_put_u4(enb_bit_octet_stream* bit_octet_stream, uint8_t value);
 static void enb_bit_octet_stream_free(enb_bit_octet_stream* bit_octet_stream);
 
-static void enb_anim_track_init_stream_init(enb_anim_track_init_stream* track_init_stream);
+static void enb_anim_track_init_stream_init(enb_anim_track_init_stream* track_init_stream, enb_arena* arena);
 static void enb_anim_track_init_stream_copy_to_byte_stream(enb_anim_track_init_stream* track_init_stream,
     enb_byte_stream* i2_stream, enb_byte_stream* i8_stream,
     enb_byte_stream* i16_stream, enb_byte_stream* i32_stream);
 static void enb_anim_track_init_stream_put_value(enb_anim_track_init_stream* track_init_stream, int32_t value);
 static void enb_anim_track_init_stream_free(enb_anim_track_init_stream* track_init_stream);
 
-static void enb_anim_track_stream_init(enb_anim_track_stream* track_stream);
+static void enb_anim_track_stream_init(enb_anim_track_stream* track_stream, enb_arena* arena);
 static void enb_anim_track_stream_copy_to_byte_stream(enb_anim_track_stream* track_stream,
     enb_byte_stream* i2_stream, enb_byte_stream* i4_stream, enb_byte_stream* i8_stream,
     enb_byte_stream* i16_stream, enb_byte_stream* i32_stream);
 static void enb_anim_track_stream_put_value(enb_anim_track_stream* track_stream, int32_t value);
+static void enb_anim_track_stream_entropy_code(enb_anim_track_stream* track_stream,
+    enb_byte_stream* i2_stream, enb_byte_stream* i4_stream, enb_byte_stream* i8_stream,
+    enb_byte_stream* i16_stream, enb_byte_stream* i32_stream, enb_byte_stream* entropy_stream);
 static void enb_anim_track_stream_free(enb_anim_track_stream* track_stream);
 
-static void enb_anim_state_stream_init(enb_anim_state_stream* state_stream);
+static void enb_anim_state_stream_init(enb_anim_state_stream* state_stream, enb_arena* arena);
 static void enb_anim_state_stream_copy_to_byte_stream(enb_anim_state_stream* state_stream,
     enb_byte_stream* u2_stream, enb_byte_stream* u8_stream,
     enb_byte_stream* u16_stream, enb_byte_stream* u32_stream);
@@ -217,10 +629,28 @@ static const int32_t value_table_track_data_i4[] = { 0, 8, 2, 3, 4, 5, 6, 7, -8,
 
 int32_t enb_process(uint8_t* data_in, uint8_t** data_out, size_t* data_out_len, float_t* duration,
     float_t* fps, int32_t* frames, quat_trans_interp_method quat_method, quat_trans_interp_method trans_method) {
+    return enb_process_ex(data_in, data_out, data_out_len, duration,
+        fps, frames, 0, quat_method, trans_method);
+}
+
+int32_t enb_process_tracks(uint8_t* data_in, uint8_t** data_out, size_t* data_out_len, float_t* duration,
+    float_t* fps, int32_t* frames, const int32_t* tracks, int32_t num_tracks,
+    quat_trans_interp_method quat_method, quat_trans_interp_method trans_method) {
+    enb_process_options options = { 0.0f, 0.0f, tracks, num_tracks, ENB_BAKE_NONE, ENB_OUTPUT_QUAT_TRANS, 0, 0 };
+    return enb_process_ex(data_in, data_out, data_out_len, duration,
+        fps, frames, &options, quat_method, trans_method);
+}
+
+int32_t enb_process_ex(uint8_t* data_in, uint8_t** data_out, size_t* data_out_len, float_t* duration,
+    float_t* fps, int32_t* frames, const enb_process_options* options,
+    quat_trans_interp_method quat_method, quat_trans_interp_method trans_method) {
     enb_anim_context* anim_ctx;
     enb_anim_stream* anim_stream;
-    quat_trans* qt_data;
-    int32_t code, i, j;
+    enb_baked_clip* baked;
+    uint8_t* track_mask;
+    const int32_t* tracks;
+    int32_t code, i, num_tracks, num_threads, output;
+    float_t start, end;
 
     if (!data_in)
         return -1;
@@ -243,7 +673,50 @@ int32_t enb_process(uint8_t* data_in, uint8_t** data_out, size_t* data_out_len,
     }
 
     anim_stream = (enb_anim_stream*)data_in;
-    *duration = anim_stream->duration;
+    tracks = options ? options->tracks : 0;
+    num_tracks = options ? options->num_tracks : 0;
+    output = options ? options->output : ENB_OUTPUT_QUAT_TRANS;
+    if (output != ENB_OUTPUT_QUAT_TRANS && output != ENB_OUTPUT_MATRIX) {
+        enb_free(&anim_ctx);
+        return -12;
+    }
+
+    start = 0.0f;
+    end = anim_stream->duration;
+    if (options) {
+        if (options->start > 0.0f)
+            start = options->start;
+        if (options->end > 0.0f && options->end < end)
+            end = options->end;
+    }
+
+    if (start > end) {
+        enb_free(&anim_ctx);
+        return -10;
+    }
+    *duration = end - start;
+
+    if (!tracks)
+        num_tracks = anim_stream->track_count;
+    else {
+        track_mask = (uint8_t*)calloc(anim_stream->track_count, sizeof(uint8_t));
+        if (!track_mask) {
+            enb_free(&anim_ctx);
+            return -8;
+        }
+
+        for (i = 0; i < num_tracks; i++) {
+            if (tracks[i] < 0 || tracks[i] >= (int32_t)anim_stream->track_count) {
+                free(track_mask);
+                enb_free(&anim_ctx);
+                return -9;
+            }
+            track_mask[tracks[i]] = 1;
+        }
+
+        enb_set_track_mask(anim_ctx, track_mask);
+        free(track_mask);
+    }
 
     if (*fps > 600.0f)
         *fps = 600.0f;
@@ -252,32 +725,150 @@ int32_t enb_process(uint8_t* data_in, uint8_t** data_out, size_t* data_out_len,
 
     float_t frames_float = *duration * *fps;
     *frames = (int32_t)(int64_t)frames_float + (fmodf(frames_float, 1.0f) >= 0.5f) + 1;
-    if (*frames > 0x7FFFFFFFU)
+    if (*frames > 0x7FFFFFFFU) {
+        enb_free(&anim_ctx);
         return -7;
+    }
 
-    *data_out_len = sizeof(quat_trans) * anim_stream->track_count * *frames + 0x10;
+    baked = 0;
+    if (options && options->bake && enb_baked_create(data_in, options->bake, &baked)) {
+        enb_free(&anim_ctx);
+        return -11;
+    }
+
+    *data_out_len = (output == ENB_OUTPUT_MATRIX ? sizeof(enb_matrix3x4) : sizeof(quat_trans))
+        * num_tracks * *frames + 0x10;
     *data_out = (uint8_t*)malloc(*data_out_len);
 
-    if (!*data_out)
+    if (!*data_out) {
+        enb_baked_free(&baked);
+        enb_free(&anim_ctx);
         return -8;
+    }
 
     memset((void*)*data_out, 0, *data_out_len);
 
-    ((int32_t*)*data_out)[0] = anim_stream->track_count;
+    ((int32_t*)*data_out)[0] = num_tracks;
     ((int32_t*)*data_out)[1] = *frames;
     ((float_t*)*data_out)[2] = *fps;
     ((float_t*)*data_out)[3] = *duration;
 
-    qt_data = (quat_trans*)(*data_out + 0x10);
-    for (i = 0; i < *frames; i++) {
-        float_t time = (float_t)i / *fps;
-        for (j = 0; j < anim_stream->track_count; j++, qt_data++)
-            enb_get_component_values(anim_ctx, time, j, qt_data, quat_method, trans_method);
+    // A thread starting mid clip only saves work when it can seek from a restart point
+    num_threads = options ? options->num_threads : 0;
+    if (!baked && !anim_ctx->restart)
+        num_threads = 1;
+    if (num_threads > *frames)
+        num_threads = *frames;
+    if (num_threads > ENB_DECODE_MAX_THREADS)
+        num_threads = ENB_DECODE_MAX_THREADS;
+    else if (num_threads < 1)
+        num_threads = 1;
+
+    // Every job past the first needs a context of its own, the run shrinks to the ones that got one
+    enb_process_job job[ENB_DECODE_MAX_THREADS];
+    job[0].anim_ctx = anim_ctx;
+    for (i = 1; i < num_threads; i++)
+        if (enb_clone(anim_ctx, &job[i].anim_ctx))
+            break;
+    num_threads = i;
+
+    for (i = 0; i < num_threads; i++) {
+        job[i].baked = baked;
+        job[i].data_out = *data_out + 0x10;
+        job[i].first_frame = (int32_t)((int64_t)*frames * i / num_threads);
+        job[i].last_frame = (int32_t)((int64_t)*frames * (i + 1) / num_threads);
+        job[i].fps = *fps;
+        job[i].start = start;
+        job[i].tracks = tracks;
+        job[i].num_tracks = num_tracks;
+        job[i].output = output;
+        job[i].scale = options ? options->scale : 0;
+        job[i].quat_method = quat_method;
+        job[i].trans_method = trans_method;
     }
+
+    enb_run_jobs(enb_process_thread, job, num_threads, sizeof(enb_process_job));
+    for (i = 1; i < num_threads; i++)
+        enb_free(&job[i].anim_ctx);
+
+    enb_baked_free(&baked);
     enb_free(&anim_ctx);
     return 0;
 }
 
+static void enb_process_frames(const enb_process_job* job) {
+    if (job->output == ENB_OUTPUT_MATRIX) {
+        enb_process_matrices(job);
+        return;
+    }
+
+    const int32_t num_tracks = job->num_tracks;
+    quat_trans* qt_data = &((quat_trans*)job->data_out)[(size_t)job->first_frame * num_tracks];
+    for (int32_t i = job->first_frame; i < job->last_frame; i++) {
+        float_t time = job->start + (float_t)i / job->fps;
+        for (int32_t j = 0; j < num_tracks; j++, qt_data++) {
+            const int32_t track_id = job->tracks ? job->tracks[j] : j;
+            if (job->baked)
+                enb_baked_get_values(job->baked, time, track_id, qt_data, job->quat_method, job->trans_method);
+            else
+                enb_get_component_values(job->anim_ctx, time, track_id, qt_data,
+                    job->quat_method, job->trans_method);
+            qt_data->time -= job->start;
+        }
+    }
+}
+
+#ifdef _WIN32
+static DWORD WINAPI enb_process_thread(LPVOID arg) {
+#else
+static void* enb_process_thread(void* arg) {
+#endif
+    enb_process_frames((const enb_process_job*)arg);
+    return 0;
+}
+
+static void enb_process_matrices(const enb_process_job* job) {
+    enb_anim_context* anim_ctx = job->anim_ctx;
+    const enb_baked_clip* baked = job->baked;
+    const int32_t* tracks = job->tracks;
+    const int32_t num_tracks = job->num_tracks;
+    const vec3* scale = job->scale;
+    const quat_trans_interp_method quat_method = job->quat_method;
+    const quat_trans_interp_method trans_method = job->trans_method;
+    int32_t index[ENB_MATRIX_BATCH];
+    quat_trans pose;
+    enb_matrix_batch batch;
+
+    for (int32_t i = job->first_frame; i < job->last_frame; i++) {
+        float_t time = job->start + (float_t)i / job->fps;
+        enb_matrix3x4* frame = &((enb_matrix3x4*)job->data_out)[(size_t)i * num_tracks];
+        for (int32_t j = 0; j < num_tracks; j += ENB_MATRIX_BATCH) {
+            int32_t count = num_tracks - j < ENB_MATRIX_BATCH ? num_tracks - j : ENB_MATRIX_BATCH;
+            for (int32_t k = 0; k < count; k++)
+                index[k] = tracks ? tracks[j + k] : j + k;
+
+            if (!baked) {
+                enb_get_matrices_batch(anim_ctx, time, index, count, scale, &frame[j], quat_method, trans_method);
+                continue;
+            }
+
+            // Baked poses are already blended, they're only copied in to share the conversion loop
+            for (int32_t k = 0; k < count; k++) {
+                enb_baked_get_values(baked, time, index[k], &pose, quat_method, trans_method);
+                batch.qx[k] = pose.quat.x;
+                batch.qy[k] = pose.quat.y;
+                batch.qz[k] = pose.quat.z;
+                batch.qw[k] = pose.quat.w;
+                batch.tx[k] = pose.trans.x;
+                batch.ty[k] = pose.trans.y;
+                batch.tz[k] = pose.trans.z;
+                enb_matrix_batch_put_scale(&batch, k, scale ? &scale[index[k]] : 0);
+            }
+            enb_matrix_batch_convert(&batch, count, &frame[j]);
+        }
+    }
+}
+
 int32_t enb_initialize(uint8_t* data, enb_anim_context** anim_ctx) {
     if (!data)
         return -1;
@@ -286,6 +877,9 @@ int32_t enb_initialize(uint8_t* data, enb_anim_context** anim_ctx) {
     *anim_ctx = 0;
 
     enb_anim_stream* anim_stream = (enb_anim_stream*)data;
+    if (anim_stream->signature & ~ENB_SIGNATURE_MASK)
+        return -5;
+
     enb_anim_context* ac = (enb_anim_context*)malloc(sizeof(enb_anim_context));
     if (!ac)
         return -3;
@@ -293,17 +887,91 @@ int32_t enb_initialize(uint8_t* data, enb_anim_context** anim_ctx) {
     memset((void*)ac, 0, sizeof(enb_anim_context));
 
     ac->data.stream = anim_stream;
+    if (anim_stream->signature & ENB_SIGNATURE_RESTART) {
+        ac->restart = (const enb_anim_restart_header*)enb_anim_stream_get_restart(anim_stream);
+        if (!ac->restart->interval
+            || ac->restart->point_length != enb_anim_restart_get_point_length(anim_stream->track_count)) {
+            free(ac);
+            return -6;
+        }
+    }
+    if (anim_stream->signature & ENB_SIGNATURE_ENTROPY_CODED) {
+        ac->rans = (enb_anim_rans_decoder*)malloc(sizeof(enb_anim_rans_decoder));
+        if (!ac->rans || !enb_anim_rans_decoder_init(ac->rans, anim_stream)) {
+            free(ac->rans);
+            free(ac);
+            return -6;
+        }
+    }
     enb_init(ac, anim_stream);
 
+    if (ac->predictor) {
+        ac->predictor_reader = enb_anim_predictor_reader_create(anim_stream->track_count);
+        if (!ac->predictor_reader) {
+            free(ac->rans);
+            free(ac);
+            return -4;
+        }
+    }
+
     ac->data.track = (enb_track*)malloc(sizeof(enb_track) * anim_stream->track_count);
 
     if (!ac->data.track) {
+        free(ac->predictor_reader);
+        free(ac->rans);
         free(ac);
         return -4;
     }
 
     memset((void*)ac->data.track, 0, sizeof(enb_track) * anim_stream->track_count);
 
+    ac->static_track = (uint8_t*)malloc(anim_stream->track_count);
+
+    if (!ac->static_track) {
+        free(ac->data.track);
+        free(ac->predictor_reader);
+        free(ac->rans);
+        free(ac);
+        return -4;
+    }
+
+    enb_find_static_tracks(ac);
+
+    *anim_ctx = ac;
+    return 0;
+}
+
+// Shares the stream and the static track scan of the source, the clone starts before the first sample
+static int32_t enb_clone(const enb_anim_context* source, enb_anim_context** anim_ctx) {
+    const int32_t track_count = source->data.stream->track_count;
+    *anim_ctx = 0;
+
+    enb_anim_context* ac = (enb_anim_context*)malloc(sizeof(enb_anim_context));
+    if (!ac)
+        return -3;
+
+    *ac = *source;
+    ac->data.track = (enb_track*)calloc(track_count, sizeof(enb_track));
+    ac->static_track = (uint8_t*)malloc(track_count);
+    ac->track_mask = source->track_mask ? (uint8_t*)malloc(track_count) : 0;
+    ac->seek_pose = 0;
+    ac->rans = source->rans ? (enb_anim_rans_decoder*)malloc(sizeof(enb_anim_rans_decoder)) : 0;
+    ac->predictor_reader = source->predictor_reader ? enb_anim_predictor_reader_create(track_count) : 0;
+    if (!ac->data.track || !ac->static_track || (source->track_mask && !ac->track_mask)
+        || (source->rans && !ac->rans) || (source->predictor_reader && !ac->predictor_reader)) {
+        enb_free(&ac);
+        return -4;
+    }
+
+    memcpy(ac->static_track, source->static_track, track_count);
+    if (ac->track_mask)
+        memcpy(ac->track_mask, source->track_mask, track_count);
+    if (ac->rans)
+        *ac->rans = *source->rans;
+
+    enb_invalidate_time(ac);
+    ac->track_direction = 0;
+    enb_init_decoder(ac);
     *anim_ctx = ac;
     return 0;
 }
@@ -313,187 +981,2008 @@ void enb_free(enb_anim_context** anim_ctx) {
         return;
 
     free((*anim_ctx)->data.track);
+    free((*anim_ctx)->static_track);
+    free((*anim_ctx)->track_mask);
+    free((*anim_ctx)->seek_pose);
+    free((*anim_ctx)->rans);
+    free((*anim_ctx)->predictor_reader);
     free(*anim_ctx);
     *anim_ctx = 0;
 }
 
 void enb_get_component_values(enb_anim_context* anim_ctx, float_t time, int32_t track_id,
     quat_trans* data, quat_trans_interp_method quat_method, quat_trans_interp_method trans_method) {
-    quat_trans* prev = 0;
-    quat_trans* next = 0;
-    enb_get_track_data(anim_ctx, track_id, &prev, &next, time);
+    const quat_trans* prev;
+    const quat_trans* next;
+    const float_t blend = enb_get_track_pair(anim_ctx, track_id, time, &prev, &next);
+
+    if (prev == next) {
+        data->quat = next->quat;
+        data->trans = next->trans;
+        data->time = time;
+        return;
+    }
 
-    float_t blend = (time - prev->time) / anim_ctx->seconds_per_sample;
     interp_quat_trans(prev, next, data, blend, quat_method, trans_method);
 }
 
-int32_t enb_encode_data(quat_trans* track_data, int32_t* track_data_count, int32_t num_tracks,
-    int32_t num_components, float_t duration, int32_t sample_rate, float_t quantization_error,
-    quat_trans_interp_method quat_method, quat_trans_interp_method trans_method,
-    uint8_t** data_out, size_t* data_out_len) {
-    if (num_components != 7)
-        return -1;
+void enb_get_sample_values(enb_anim_context* anim_ctx, float_t sample, int32_t track_id,
+    quat_trans* data, quat_trans_interp_method quat_method, quat_trans_interp_method trans_method) {
+    const uint32_t last_sample = anim_ctx->sample_count - 1;
+    uint32_t next_sample;
+    float_t blend;
+
+    if (sample <= 0.0f)
+        sample = 0.0f;
+    else if (sample >= (float_t)last_sample)
+        sample = (float_t)last_sample;
+
+    next_sample = (uint32_t)ceilf(sample);
+    blend = 1.0f - ((float_t)next_sample - sample);
+
+    if (anim_ctx->requested_time == -1.0f || anim_ctx->data.current_sample != next_sample)
+        enb_set_sample(anim_ctx, next_sample);
+
+    quat_trans* prev = enb_get_track_data_prev(anim_ctx, track_id);
+    quat_trans* next = enb_get_track_data_next(anim_ctx, track_id);
+    if (anim_ctx->static_track[track_id]) {
+        data->quat = next->quat;
+        data->trans = next->trans;
+        data->time = sample * anim_ctx->seconds_per_sample;
+        return;
+    }
 
-    enb_plain_animation plain_anim;
-    enb_plain_anim_init(&plain_anim);
-    enb_plain_anim_prepare_data(&plain_anim, track_data, track_data_count, num_tracks,
-        7, duration, sample_rate, quantization_error, quat_method, trans_method);
-    enb_plain_anim_write_data(&plain_anim, num_tracks, 7, duration,
-        sample_rate, quantization_error, data_out, data_out_len);
-    enb_plain_anim_free(&plain_anim);
-    return 0;
+    interp_quat_trans(prev, next, data, blend, quat_method, trans_method);
 }
 
-static void enb_get_track_data(enb_anim_context* anim_ctx, int32_t track_id,
-    quat_trans** prev, quat_trans** next, float_t time) { // 0x08A8C34
-    if (time < anim_ctx->data.previous_sample_time
-        || time > anim_ctx->data.current_sample_time)
-        enb_set_time(anim_ctx, time);
-
-    *next = enb_get_track_data_next(anim_ctx, track_id);
-    *prev = enb_get_track_data_prev(anim_ctx, track_id);
-}
+int32_t enb_get_component_values_batch(enb_anim_context* anim_ctx, const float_t* times, int32_t num_times,
+    const int32_t* tracks, int32_t num_tracks, quat_trans* data,
+    quat_trans_interp_method quat_method, quat_trans_interp_method trans_method) {
+    if (!anim_ctx)
+        return -1;
+    else if (!times || num_times < 0 || !data)
+        return -2;
 
-static quat_trans* enb_get_track_data_next(enb_anim_context* anim_ctx, int32_t track_id) {
-    return &anim_ctx->data.track[track_id].qt[anim_ctx->track_selector & 0x01];
-}
+    const int32_t track_count = anim_ctx->data.stream->track_count;
+    if (!tracks)
+        num_tracks = track_count;
+    else if (num_tracks < 0)
+        return -2;
+    else
+        for (int32_t i = 0; i < num_tracks; i++)
+            if (tracks[i] < 0 || tracks[i] >= track_count)
+                return -2;
 
-static quat_trans* enb_get_track_data_prev(enb_anim_context* anim_ctx, int32_t track_id) {
-    return &anim_ctx->data.track[track_id].qt[(anim_ctx->track_selector & 0x01) ^ 0x01];
-}
+    enb_time_query* query = (enb_time_query*)malloc(sizeof(enb_time_query) * num_times);
+    if (!query && num_times)
+        return -3;
 
-static void enb_init(enb_anim_context* anim_ctx, enb_anim_stream* anim_stream) { // 0x08A08050 in ULJM05681
-    uint8_t* data;
-    uint32_t temp;
+    for (int32_t i = 0; i < num_times; i++) {
+        query[i].time = times[i];
+        query[i].index = i;
+    }
 
-    data = (uint8_t*)anim_stream;
-    anim_ctx->data.current_sample = -1;
-    anim_ctx->data.current_sample_time = -1.0f;
-    anim_ctx->data.previous_sample_time = -1.0f;
-    anim_ctx->requested_time = -1.0f;
-    anim_ctx->seconds_per_sample = 1.0f / (float_t)anim_stream->sample_rate;
-    anim_ctx->track_direction = 0;
+    // Visiting the times in ascending order keeps the decoder stepping forward only
+    qsort(query, num_times, sizeof(enb_time_query), enb_time_query_compare);
 
-    anim_ctx->data.data_length = enb_anim_stream_get_length(anim_stream);
-    anim_ctx->track_flags = enb_anim_stream_get_track_flags(anim_stream);
-    anim_ctx->track_data_init.i2 = (const uint8_t*)enb_anim_stream_get_track_data_init_i2(anim_stream);
-    anim_ctx->track_data_init.i8 = (const int8_t*)enb_anim_stream_get_track_data_init_i8(anim_stream);
-    anim_ctx->track_data_init.i16 = (const int16_t*)enb_anim_stream_get_track_data_init_i16(anim_stream);
-    anim_ctx->track_data_init.i32 = (const int32_t*)enb_anim_stream_get_track_data_init_i32(anim_stream);
-    anim_ctx->track_data.i2 = (const uint8_t*)enb_anim_stream_get_track_data_i2(anim_stream);
-    anim_ctx->track_data.i4 = (const uint8_t*)enb_anim_stream_get_track_data_i4(anim_stream);
-    anim_ctx->track_data.i8 = (const int8_t*)enb_anim_stream_get_track_data_i8(anim_stream);
-    anim_ctx->track_data.i16 = (const int16_t*)enb_anim_stream_get_track_data_i16(anim_stream);
-    anim_ctx->track_data.i32 = (const int32_t*)enb_anim_stream_get_track_data_i32(anim_stream);
-    anim_ctx->state_data.u2 = enb_anim_stream_get_state_data_u2(anim_stream);
-    anim_ctx->state_data.u8 = enb_anim_stream_get_state_data_u8(anim_stream);
-    anim_ctx->state_data.u16 = (const uint16_t*)enb_anim_stream_get_state_data_u16(anim_stream);
-    anim_ctx->state_data.u32 = (const uint32_t*)enb_anim_stream_get_state_data_u32(anim_stream);
-    anim_ctx->state_data.u8 = enb_anim_stream_get_state_data_u8(anim_stream);
-    anim_ctx->state_data.u8 = enb_anim_stream_get_state_data_u8(anim_stream);
+    for (int32_t i = 0; i < num_times; i++) {
+        quat_trans* qt = &data[(size_t)query[i].index * num_tracks];
+        for (int32_t j = 0; j < num_tracks; j++)
+            enb_get_component_values(anim_ctx, query[i].time, tracks ? tracks[j] : j,
+                &qt[j], quat_method, trans_method);
+    }
 
-    enb_init_decoder(anim_ctx);
+    free(query);
+    return 0;
 }
 
-static void enb_init_decoder(enb_anim_context* anim_ctx) { // 0x08A07FD0 in ULJM05681
-    anim_ctx->track_data_init_dec.i2 = anim_ctx->track_data_init.i2;
-    anim_ctx->track_data_init_dec.i8 = anim_ctx->track_data_init.i8;
-    anim_ctx->track_data_init_dec.i16 = anim_ctx->track_data_init.i16;
-    anim_ctx->track_data_init_dec.i32 = anim_ctx->track_data_init.i32;
-    anim_ctx->track_data_init_dec.i2_counter = 0;
-
-    anim_ctx->track_data_dec.i2 = anim_ctx->track_data.i2;
-    anim_ctx->track_data_dec.i4 = anim_ctx->track_data.i4;
-    anim_ctx->track_data_dec.i8 = anim_ctx->track_data.i8;
-    anim_ctx->track_data_dec.i16 = anim_ctx->track_data.i16;
-    anim_ctx->track_data_dec.i32 = anim_ctx->track_data.i32;
-    anim_ctx->track_data_dec.i2_counter = 0;
-    anim_ctx->track_data_dec.i4_counter = 0;
+int32_t enb_get_matrices(enb_anim_context* anim_ctx, float_t time, const int32_t* tracks, int32_t num_tracks,
+    const vec3* scale, enb_matrix3x4* data, quat_trans_interp_method quat_method, quat_trans_interp_method trans_method) {
+    if (!anim_ctx)
+        return -1;
+    else if (!data)
+        return -2;
 
-    anim_ctx->state_data_dec.u2 = anim_ctx->state_data.u2;
-    anim_ctx->state_data_dec.u8 = anim_ctx->state_data.u8;
-    anim_ctx->state_data_dec.u16 = anim_ctx->state_data.u16;
-    anim_ctx->state_data_dec.u32 = anim_ctx->state_data.u32;
-    anim_ctx->state_data_dec.u2_counter = 0;
+    const int32_t track_count = anim_ctx->data.stream->track_count;
+    if (!tracks)
+        num_tracks = track_count;
+    else if (num_tracks < 0)
+        return -2;
+    else
+        for (int32_t i = 0; i < num_tracks; i++)
+            if (tracks[i] < 0 || tracks[i] >= track_count)
+                return -2;
+
+    int32_t index[ENB_MATRIX_BATCH];
+    for (int32_t i = 0; i < num_tracks; i += ENB_MATRIX_BATCH) {
+        int32_t count = num_tracks - i < ENB_MATRIX_BATCH ? num_tracks - i : ENB_MATRIX_BATCH;
+        for (int32_t j = 0; j < count; j++)
+            index[j] = tracks ? tracks[i + j] : i + j;
+        enb_get_matrices_batch(anim_ctx, time, index, count, scale, &data[i], quat_method, trans_method);
+    }
+    return 0;
 }
 
-static void enb_set_time(enb_anim_context* anim_ctx, float_t time) { // 0x08A0876C in ULJM05681
-    int32_t track_count;
-    float_t quantization_error;
-    float_t requested_time;
-    float_t sps; // seconds per sample
-
-    if (time == anim_ctx->requested_time)
-        return;
-
-    track_count = anim_ctx->data.stream->track_count;
-    quantization_error = anim_ctx->data.stream->quantization_error;
-    requested_time = anim_ctx->requested_time;
-    sps = anim_ctx->seconds_per_sample;
-
-    if ((requested_time == -1.0f) || (0.000001f > time) || (requested_time - time > time)
-        || ((sps <= requested_time) && (sps > time))) {
-        anim_ctx->data.current_sample = 0;
-        anim_ctx->data.current_sample_time = 0.0f;
-        anim_ctx->data.previous_sample_time = 0.0f;
-        anim_ctx->track_direction = 0;
+int32_t enb_get_instances_values(const enb_anim_instance* instances, int32_t num_instances,
+    quat_trans* data, quat_trans_interp_method quat_method, quat_trans_interp_method trans_method) {
+    if (!instances || num_instances < 0)
+        return -1;
 
-        enb_init_decoder(anim_ctx);
-        enb_state_step_init(&anim_ctx->state, &anim_ctx->state_data_dec);
-        enb_track_init(anim_ctx, track_count, &anim_ctx->track_data_init_dec);
-        enb_track_init_apply(anim_ctx, track_count, anim_ctx->track_flags, quantization_error);
+    size_t pose_count = 0;
+    for (int32_t i = 0; i < num_instances; i++) {
+        if (!instances[i].context)
+            return -2;
+        pose_count += instances[i].context->data.stream->track_count;
     }
 
-    anim_ctx->requested_time = time;
-    if (time < 0.000001f)
-        return;
-
-    while ((time > anim_ctx->data.current_sample_time)
-        && (anim_ctx->data.stream->duration - anim_ctx->data.current_sample_time > 0.00001f)) {
-        if (anim_ctx->track_direction == 2) {
-            enb_anim_state_data_forward_decode(&anim_ctx->state_data_dec);
-            anim_ctx->track_direction = 1;
-        }
-        else if (anim_ctx->data.current_sample > 0) {
-            enb_state_step_forward(&anim_ctx->state,
-                anim_ctx->data.track, track_count, &anim_ctx->state_data_dec);
-            anim_ctx->track_direction = 1;
-        }
-
-        enb_track_step_forward(anim_ctx, track_count, &anim_ctx->track_data_dec);
-        requested_time = ++anim_ctx->data.current_sample * sps;
+    if (!data)
+        return (int32_t)pose_count;
 
-        if (anim_ctx->data.stream->duration <= requested_time)
-            requested_time = anim_ctx->data.stream->duration;
+    enb_instance_query* query = (enb_instance_query*)malloc(sizeof(enb_instance_query) * num_instances);
+    if (!query && num_instances)
+        return -3;
 
-        enb_track_apply(anim_ctx, track_count, true, quantization_error, requested_time);
-        anim_ctx->data.current_sample_time = anim_ctx->data.current_sample * sps;
-        anim_ctx->data.previous_sample_time = (anim_ctx->data.current_sample - 1) * sps;
+    pose_count = 0;
+    for (int32_t i = 0; i < num_instances; i++) {
+        query[i].stream = instances[i].context->data.stream;
+        query[i].time = instances[i].time;
+        query[i].index = i;
+        query[i].offset = pose_count;
+        pose_count += query[i].stream->track_count;
     }
 
-    while (time < anim_ctx->data.previous_sample_time) {
-        if (anim_ctx->track_direction == 1) {
-            enb_anim_state_data_backward_decode(&anim_ctx->state_data_dec);
-            anim_ctx->track_direction = 2;
+    // Grouping by clip keeps one stream hot in cache and lets every context only step forward
+    qsort(query, num_instances, sizeof(enb_instance_query), enb_instance_query_compare);
+
+    uint32_t prev_sample = 0;
+    float_t prev_blend = 0.0f;
+    for (int32_t i = 0; i < num_instances; i++) {
+        enb_anim_context* anim_ctx = instances[query[i].index].context;
+        const int32_t track_count = query[i].stream->track_count;
+        quat_trans* qt = &data[query[i].offset];
+
+        float_t blend;
+        const uint32_t sample = enb_find_sample(anim_ctx, query[i].time, &blend);
+
+        // Unmasked instances of one clip that land on the same sample pair and blend decode to the same pose,
+        // sample 0 covers the times enb_set_time doesn't seek for, which still blend by time
+        if (i > 0 && query[i - 1].stream == query[i].stream && prev_sample == sample && prev_blend == blend
+            && (sample || query[i - 1].time == query[i].time)
+            && !anim_ctx->track_mask && !instances[query[i - 1].index].context->track_mask) {
+            memcpy(qt, &data[query[i - 1].offset], sizeof(quat_trans) * track_count);
+            for (int32_t j = 0; j < track_count; j++)
+                if (anim_ctx->static_track[j])
+                    qt[j].time = query[i].time;
         }
         else
-            enb_state_step_backward(&anim_ctx->state,
-                anim_ctx->data.track, track_count, &anim_ctx->state_data_dec);
+            for (int32_t j = 0; j < track_count; j++)
+                enb_get_component_values(anim_ctx, query[i].time, j, &qt[j], quat_method, trans_method);
 
-        anim_ctx->data.current_sample--;
-        enb_track_step_backward(anim_ctx, track_count, &anim_ctx->track_data_dec);
-
-        anim_ctx->data.current_sample_time = anim_ctx->data.current_sample * sps;
-        anim_ctx->data.previous_sample_time = (anim_ctx->data.current_sample - 1) * sps;
-        enb_track_apply(anim_ctx, track_count, false, -quantization_error, anim_ctx->data.previous_sample_time);
+        prev_sample = sample;
+        prev_blend = blend;
     }
+
+    free(query);
+    return (int32_t)pose_count;
 }
 
-static void enb_track_init(enb_anim_context* anim_ctx,
-    const int32_t track_count, enb_anim_track_data_init_decoder* track_data_init) { // 0x08A08D3C in ULJM05681
-    int32_t i, j, val;
+int32_t enb_pose_cache_create(size_t memory_limit, enb_pose_cache** cache) {
+    if (!cache)
+        return -1;
 
-    enb_track* track = anim_ctx->data.track;
+    enb_pose_cache* pc = (enb_pose_cache*)malloc(sizeof(enb_pose_cache));
+    if (!pc)
+        return -2;
+
+    memset((void*)pc, 0, sizeof(enb_pose_cache));
+    pc->stats.memory_limit = memory_limit;
+
+    // Sized for 64 track poses per entry, chains just get longer for bigger rigs
+    size_t entry_count = memory_limit / (sizeof(enb_pose_cache_entry) + sizeof(quat_trans) * 0x40);
+    pc->bucket_count = ENB_POSE_CACHE_MIN_BUCKETS;
+    while (pc->bucket_count < entry_count && pc->bucket_count < ENB_POSE_CACHE_MAX_BUCKETS)
+        pc->bucket_count <<= 1;
+
+    pc->bucket = (enb_pose_cache_entry**)malloc(sizeof(enb_pose_cache_entry*) * pc->bucket_count);
+    if (!pc->bucket) {
+        free(pc);
+        return -2;
+    }
+    memset((void*)pc->bucket, 0, sizeof(enb_pose_cache_entry*) * pc->bucket_count);
+
+#ifdef _WIN32
+    InitializeCriticalSection(&pc->lock);
+#else
+    if (pthread_mutex_init(&pc->lock, 0)) {
+        free(pc->bucket);
+        free(pc);
+        return -3;
+    }
+#endif
+
+    *cache = pc;
+    return 0;
+}
+
+void enb_pose_cache_free(enb_pose_cache** cache) {
+    if (!cache || !*cache)
+        return;
+
+    enb_pose_cache_clear(*cache, 0);
+#ifdef _WIN32
+    DeleteCriticalSection(&(*cache)->lock);
+#else
+    pthread_mutex_destroy(&(*cache)->lock);
+#endif
+    free((*cache)->bucket);
+    free(*cache);
+    *cache = 0;
+}
+
+void enb_pose_cache_clear(enb_pose_cache* cache, const enb_anim_context* anim_ctx) {
+    if (!cache)
+        return;
+
+    enb_pose_cache_lock(cache);
+    enb_pose_cache_entry* entry = cache->lru_head;
+    while (entry) {
+        enb_pose_cache_entry* next = entry->lru_next;
+        if (!anim_ctx || entry->stream == anim_ctx->data.stream)
+            enb_pose_cache_remove(cache, entry);
+        entry = next;
+    }
+    enb_pose_cache_unlock(cache);
+}
+
+void enb_pose_cache_get_stats(enb_pose_cache* cache, enb_pose_cache_stats* stats) {
+    if (!cache || !stats)
+        return;
+
+    enb_pose_cache_lock(cache);
+    *stats = cache->stats;
+    enb_pose_cache_unlock(cache);
+}
+
+int32_t enb_pose_cache_get_values(enb_pose_cache* cache, enb_anim_context* anim_ctx, float_t time,
+    quat_trans* data, quat_trans_interp_method quat_method, quat_trans_interp_method trans_method) {
+    if (!cache || !anim_ctx || !data)
+        return -1;
+
+    const enb_anim_stream* stream = anim_ctx->data.stream;
+    const int32_t track_count = stream->track_count;
+
+    // A masked context leaves some poses stale, so it can neither fill nor use shared entries
+    if (anim_ctx->track_mask) {
+        for (int32_t i = 0; i < track_count; i++)
+            enb_get_component_values(anim_ctx, time, i, &data[i], quat_method, trans_method);
+        return 0;
+    }
+
+    float_t blend;
+    const uint32_t sample = enb_find_sample(anim_ctx, time, &blend);
+    const uint32_t prev_sample = sample ? sample - 1 : 0;
+
+    enb_pose_cache_lock(cache);
+    enb_pose_cache_entry* prev = enb_pose_cache_find(cache, stream, prev_sample);
+    enb_pose_cache_entry* next = enb_pose_cache_find(cache, stream, sample);
+    if (prev && next) {
+        cache->stats.hits += 2;
+        enb_pose_cache_touch(cache, prev);
+        enb_pose_cache_touch(cache, next);
+        for (int32_t i = 0; i < track_count; i++)
+            interp_quat_trans(&prev->pose[i], &next->pose[i], &data[i], blend, quat_method, trans_method);
+        enb_pose_cache_unlock(cache);
+        return 0;
+    }
+
+    cache->stats.hits += (prev ? 1 : 0) + (next ? 1 : 0);
+    cache->stats.misses += (prev ? 0 : 1) + (next ? 0 : 1);
+    enb_pose_cache_unlock(cache);
+
+    // Decoding runs unlocked, the context belongs to the caller
+    enb_blend_sample(anim_ctx, sample, blend, data, quat_method, trans_method);
+
+    enb_pose_cache_lock(cache);
+    if (!prev)
+        enb_pose_cache_insert(cache, anim_ctx, prev_sample, false);
+    if (!next && sample != prev_sample)
+        enb_pose_cache_insert(cache, anim_ctx, sample, true);
+    enb_pose_cache_unlock(cache);
+    return 0;
+}
+
+int32_t enb_prefetch_create(uint8_t* data, int32_t capacity, enb_prefetch** prefetch) {
+    if (!data || !prefetch)
+        return -1;
+    else if (capacity < 2)
+        return -2;
+
+    enb_prefetch* pf = (enb_prefetch*)malloc(sizeof(enb_prefetch));
+    if (!pf)
+        return -3;
+
+    memset((void*)pf, 0, sizeof(enb_prefetch));
+    if (enb_initialize(data, &pf->producer_ctx) || enb_initialize(data, &pf->consumer_ctx)) {
+        enb_free(&pf->producer_ctx);
+        free(pf);
+        return -4;
+    }
+
+    pf->track_count = pf->consumer_ctx->data.stream->track_count;
+    pf->capacity = capacity;
+    pf->slot = (enb_prefetch_slot*)malloc(sizeof(enb_prefetch_slot) * capacity);
+    pf->pose = (quat_trans*)malloc(sizeof(quat_trans) * capacity * pf->track_count);
+    if (!pf->slot || !pf->pose) {
+        free(pf->slot);
+        free(pf->pose);
+        enb_free(&pf->producer_ctx);
+        enb_free(&pf->consumer_ctx);
+        free(pf);
+        return -3;
+    }
+
+    int32_t code = 0;
+#ifdef _WIN32
+    InitializeCriticalSection(&pf->lock);
+    InitializeConditionVariable(&pf->wake);
+    pf->thread = CreateThread(0, 0, enb_prefetch_thread, pf, 0, 0);
+    if (!pf->thread) {
+        DeleteCriticalSection(&pf->lock);
+        code = -5;
+    }
+#else
+    if (pthread_mutex_init(&pf->lock, 0))
+        code = -6;
+    else if (pthread_cond_init(&pf->wake, 0)) {
+        pthread_mutex_destroy(&pf->lock);
+        code = -6;
+    }
+    else if (pthread_create(&pf->thread, 0, enb_prefetch_thread, pf)) {
+        pthread_cond_destroy(&pf->wake);
+        pthread_mutex_destroy(&pf->lock);
+        code = -5;
+    }
+#endif
+
+    if (code) {
+        free(pf->slot);
+        free(pf->pose);
+        enb_free(&pf->producer_ctx);
+        enb_free(&pf->consumer_ctx);
+        free(pf);
+        return code;
+    }
+
+    *prefetch = pf;
+    return 0;
+}
+
+void enb_prefetch_free(enb_prefetch** prefetch) {
+    if (!prefetch || !*prefetch)
+        return;
+
+    enb_prefetch* pf = *prefetch;
+    __atomic_store_n(&pf->stop, 1, __ATOMIC_SEQ_CST);
+    enb_prefetch_notify(pf);
+#ifdef _WIN32
+    WaitForSingleObject(pf->thread, INFINITE);
+    CloseHandle(pf->thread);
+    DeleteCriticalSection(&pf->lock);
+#else
+    pthread_join(pf->thread, 0);
+    pthread_cond_destroy(&pf->wake);
+    pthread_mutex_destroy(&pf->lock);
+#endif
+    free(pf->slot);
+    free(pf->pose);
+    enb_free(&pf->producer_ctx);
+    enb_free(&pf->consumer_ctx);
+    free(*prefetch);
+    *prefetch = 0;
+}
+
+int32_t enb_prefetch_get_values(enb_prefetch* prefetch, float_t time, quat_trans* data,
+    quat_trans_interp_method quat_method, quat_trans_interp_method trans_method) {
+    if (!prefetch || !data)
+        return -1;
+
+    const int32_t track_count = prefetch->track_count;
+    const uint32_t capacity = prefetch->capacity;
+    float_t blend;
+    const uint32_t sample = enb_find_sample(prefetch->consumer_ctx, time, &blend);
+    const uint32_t prev_sample = sample ? sample - 1 : 0;
+
+    // Slots behind the playhead or from an abandoned seek go back to the worker
+    const uint32_t head = __atomic_load_n(&prefetch->head, __ATOMIC_ACQUIRE);
+    uint32_t tail = prefetch->tail;
+    while (tail != head) {
+        enb_prefetch_slot* slot = &prefetch->slot[tail % capacity];
+        if (slot->generation == prefetch->generation && slot->sample >= prev_sample)
+            break;
+        tail++;
+    }
+
+    if (tail != prefetch->tail) {
+        __atomic_store_n(&prefetch->tail, tail, __ATOMIC_SEQ_CST);
+        enb_prefetch_notify(prefetch);
+    }
+
+    // Samples of one generation are produced back to back, so the pair sits in adjacent slots
+    if (tail != head && prefetch->slot[tail % capacity].sample == prev_sample) {
+        uint32_t next = sample == prev_sample ? tail : tail + 1;
+        if (next != head && prefetch->slot[next % capacity].generation == prefetch->generation) {
+            quat_trans* prev_pose = &prefetch->pose[(size_t)(tail % capacity) * track_count];
+            quat_trans* next_pose = &prefetch->pose[(size_t)(next % capacity) * track_count];
+            for (int32_t i = 0; i < track_count; i++)
+                interp_quat_trans(&prev_pose[i], &next_pose[i], &data[i], blend, quat_method, trans_method);
+            return 0;
+        }
+    }
+
+    enb_blend_sample(prefetch->consumer_ctx, sample, blend, data, quat_method, trans_method);
+
+    // Restart the worker at the playhead unless it is about to deliver the missing sample
+    if (tail == head || prefetch->slot[tail % capacity].sample != prev_sample) {
+        __atomic_store_n(&prefetch->seek_sample, prev_sample, __ATOMIC_RELAXED);
+        __atomic_store_n(&prefetch->seek_generation, ++prefetch->generation, __ATOMIC_SEQ_CST);
+        enb_prefetch_notify(prefetch);
+    }
+    return 1;
+}
+
+int32_t enb_seek_time_budget(enb_anim_context* anim_ctx, float_t time, int32_t max_samples) {
+    if (!anim_ctx)
+        return -1;
+
+    const int32_t track_count = anim_ctx->data.stream->track_count;
+    if (!anim_ctx->seek_pending || anim_ctx->seek_time != time) {
+        if (time == anim_ctx->requested_time && !anim_ctx->seek_pending)
+            return 0;
+
+        // Retargeting a running seek keeps the snapshot, it is still the last finished pose
+        if (!anim_ctx->seek_pending) {
+            if (!anim_ctx->seek_pose) {
+                anim_ctx->seek_pose = (quat_trans*)malloc(sizeof(quat_trans) * 2 * track_count);
+                if (!anim_ctx->seek_pose)
+                    return -2;
+            }
+
+            anim_ctx->seek_pose_time = anim_ctx->requested_time;
+            if (anim_ctx->requested_time != -1.0f) {
+                enb_get_sample_pose(anim_ctx, false, anim_ctx->seek_pose);
+                enb_get_sample_pose(anim_ctx, true, anim_ctx->seek_pose + track_count);
+            }
+        }
+
+        float_t blend;
+        anim_ctx->seek_pending = 1;
+        anim_ctx->seek_time = time;
+        anim_ctx->seek_sample = enb_find_sample(anim_ctx, time, &blend);
+    }
+
+    uint32_t remaining = enb_step_to_sample(anim_ctx, anim_ctx->seek_sample,
+        max_samples > 0 ? (uint32_t)max_samples : 0);
+    if (remaining)
+        return remaining < 0x7FFFFFFF ? (int32_t)remaining : 0x7FFFFFFF;
+
+    // The context now holds the pair enb_set_time would land on for this time
+    anim_ctx->requested_time = time;
+    anim_ctx->seek_pending = 0;
+    return 0;
+}
+
+int32_t enb_get_seek_values(enb_anim_context* anim_ctx, int32_t track_id,
+    quat_trans* data, quat_trans_interp_method quat_method, quat_trans_interp_method trans_method) {
+    if (!anim_ctx || !data)
+        return -1;
+
+    if (!anim_ctx->seek_pending) {
+        if (anim_ctx->requested_time == -1.0f)
+            return -2;
+
+        enb_get_component_values(anim_ctx, anim_ctx->requested_time, track_id, data, quat_method, trans_method);
+        return 0;
+    }
+    else if (anim_ctx->seek_pose_time == -1.0f)
+        return -2;
+
+    quat_trans* prev = &anim_ctx->seek_pose[track_id];
+    quat_trans* next = &anim_ctx->seek_pose[anim_ctx->data.stream->track_count + track_id];
+    float_t blend = (anim_ctx->seek_pose_time - prev->time) / enb_get_sample_interval(prev->time,
+        anim_ctx->seconds_per_sample, anim_ctx->data.stream->duration);
+    interp_quat_trans(prev, next, data, blend, quat_method, trans_method);
+    return 1;
+}
+
+int32_t enb_baked_create(uint8_t* data, int32_t format, enb_baked_clip** baked) {
+    if (!data || !baked)
+        return -1;
+    else if (format != ENB_BAKE_FLOAT && format != ENB_BAKE_INT16)
+        return -2;
+
+    enb_anim_context* anim_ctx;
+    int32_t code = enb_initialize(data, &anim_ctx);
+    if (code)
+        return code - 0x10;
+
+    const int32_t track_count = anim_ctx->data.stream->track_count;
+    const uint32_t sample_count = anim_ctx->sample_count;
+
+    enb_baked_clip* bc = (enb_baked_clip*)malloc(sizeof(enb_baked_clip));
+    if (!bc) {
+        enb_free(&anim_ctx);
+        return -3;
+    }
+
+    memset((void*)bc, 0, sizeof(enb_baked_clip));
+    bc->format = format;
+    bc->track_count = track_count;
+    bc->sample_count = sample_count;
+    bc->column_count = track_count - anim_ctx->static_track_count;
+    bc->duration = anim_ctx->data.stream->duration;
+    bc->seconds_per_sample = anim_ctx->seconds_per_sample;
+    bc->pose_size = format == ENB_BAKE_INT16 ? 0x10 : 0x20;
+    bc->row_size = bc->pose_size * bc->column_count;
+
+    const size_t table_size = bc->row_size * sample_count;
+    bc->column = (int32_t*)malloc(sizeof(int32_t) * track_count);
+    bc->static_pose = (quat_trans*)malloc(sizeof(quat_trans) * (anim_ctx->static_track_count + 1));
+    bc->trans_min = (vec3*)malloc(sizeof(vec3) * (bc->column_count + 1));
+    bc->trans_scale = (vec3*)malloc(sizeof(vec3) * (bc->column_count + 1));
+    bc->table_data = (uint8_t*)malloc(table_size + ENB_BAKE_ALIGNMENT);
+    if (!bc->column || !bc->static_pose || !bc->trans_min || !bc->trans_scale || !bc->table_data) {
+        enb_baked_free(&bc);
+        enb_free(&anim_ctx);
+        return -3;
+    }
+
+    bc->table = (uint8_t*)(((size_t)bc->table_data + ENB_BAKE_ALIGNMENT - 1) & ~(size_t)(ENB_BAKE_ALIGNMENT - 1));
+    bc->size = sizeof(enb_baked_clip) + sizeof(int32_t) * track_count
+        + sizeof(quat_trans) * anim_ctx->static_track_count + table_size + ENB_BAKE_ALIGNMENT;
+    if (format == ENB_BAKE_INT16)
+        bc->size += sizeof(vec3) * 2 * bc->column_count;
+
+    int32_t column = 0;
+    int32_t static_index = 0;
+    for (int32_t i = 0; i < track_count; i++)
+        bc->column[i] = anim_ctx->static_track[i] ? -1 - static_index++ : column++;
+
+    // Int16 translations are stored relative to each track's range, found with a first decode pass
+    if (format == ENB_BAKE_INT16) {
+        for (int32_t i = 0; i < bc->column_count; i++) {
+            bc->trans_min[i] = (vec3){ FLT_MAX, FLT_MAX, FLT_MAX };
+            bc->trans_scale[i] = (vec3){ -FLT_MAX, -FLT_MAX, -FLT_MAX };
+        }
+
+        for (uint32_t s = 0; s < sample_count; s++) {
+            enb_set_sample(anim_ctx, s);
+            for (int32_t i = 0; i < track_count; i++) {
+                if (bc->column[i] < 0)
+                    continue;
+
+                const vec3 trans = enb_get_track_data_next(anim_ctx, i)->trans;
+                vec3* min = &bc->trans_min[bc->column[i]];
+                vec3* max = &bc->trans_scale[bc->column[i]];
+                min->x = min->x < trans.x ? min->x : trans.x;
+                min->y = min->y < trans.y ? min->y : trans.y;
+                min->z = min->z < trans.z ? min->z : trans.z;
+                max->x = max->x > trans.x ? max->x : trans.x;
+                max->y = max->y > trans.y ? max->y : trans.y;
+                max->z = max->z > trans.z ? max->z : trans.z;
+            }
+        }
+
+        for (int32_t i = 0; i < bc->column_count; i++) {
+            bc->trans_scale[i].x = (bc->trans_scale[i].x - bc->trans_min[i].x) / 65535.0f;
+            bc->trans_scale[i].y = (bc->trans_scale[i].y - bc->trans_min[i].y) / 65535.0f;
+            bc->trans_scale[i].z = (bc->trans_scale[i].z - bc->trans_min[i].z) / 65535.0f;
+        }
+    }
+
+    memset(bc->table, 0, table_size);
+    for (uint32_t s = 0; s < sample_count; s++) {
+        enb_set_sample(anim_ctx, s);
+        for (int32_t i = 0; i < track_count; i++) {
+            quat_trans* pose = enb_get_track_data_next(anim_ctx, i);
+            if (bc->column[i] >= 0)
+                enb_baked_put_pose(bc, s, bc->column[i], pose);
+            else if (!s)
+                bc->static_pose[-1 - bc->column[i]] = *pose;
+        }
+    }
+
+    enb_free(&anim_ctx);
+    *baked = bc;
+    return 0;
+}
+
+void enb_baked_free(enb_baked_clip** baked) {
+    if (!baked || !*baked)
+        return;
+
+    free((*baked)->column);
+    free((*baked)->static_pose);
+    free((*baked)->trans_min);
+    free((*baked)->trans_scale);
+    free((*baked)->table_data);
+    free(*baked);
+    *baked = 0;
+}
+
+size_t enb_baked_get_size(const enb_baked_clip* baked) {
+    return baked ? baked->size : 0;
+}
+
+int32_t enb_baked_get_values(const enb_baked_clip* baked, float_t time, int32_t track_id,
+    quat_trans* data, quat_trans_interp_method quat_method, quat_trans_interp_method trans_method) {
+    if (!baked || !data)
+        return -1;
+    else if (track_id < 0 || track_id >= baked->track_count)
+        return -2;
+
+    const int32_t column = baked->column[track_id];
+    if (column < 0) {
+        *data = baked->static_pose[-1 - column];
+        data->time = time;
+        return 0;
+    }
+
+    if (time > baked->duration)
+        time = baked->duration;
+    else if (time < 0.0f)
+        time = 0.0f;
+
+    // Same spacing as the stream keys
+    const float_t sps = baked->seconds_per_sample;
+    uint32_t sample = (uint32_t)(time / sps);
+    if (sample + 1 >= baked->sample_count)
+        sample = baked->sample_count > 1 ? baked->sample_count - 2 : 0;
+    const float_t blend = (time - sample * sps) / enb_get_sample_interval(sample * sps, sps, baked->duration);
+
+    quat_trans prev, next;
+    enb_baked_get_pose(baked, sample, column, &prev);
+    enb_baked_get_pose(baked, sample + 1 < baked->sample_count ? sample + 1 : sample, column, &next);
+    interp_quat_trans(&prev, &next, data, blend, quat_method, trans_method);
+    data->time = time;
+    return 0;
+}
+
+int32_t enb_decode_samples(uint8_t* data, int32_t num_threads, quat_trans* data_out) {
+    if (!data)
+        return -1;
+
+    enb_anim_context* anim_ctx;
+    int32_t code = enb_initialize(data, &anim_ctx);
+    if (code)
+        return code - 0x10;
+
+    const uint32_t sample_count = anim_ctx->sample_count;
+    const uint32_t interval = anim_ctx->restart ? anim_ctx->restart->interval : sample_count;
+    const int32_t track_count = anim_ctx->data.stream->track_count;
+    if (!data_out) {
+        enb_free(&anim_ctx);
+        return (int32_t)(sample_count * track_count);
+    }
+
+    // Threads take whole runs between restart points, without them the clip decodes on one thread
+    const uint32_t block_count = (sample_count + interval - 1) / interval;
+    if (num_threads > (int32_t)block_count)
+        num_threads = (int32_t)block_count;
+    if (num_threads > ENB_DECODE_MAX_THREADS)
+        num_threads = ENB_DECODE_MAX_THREADS;
+    else if (num_threads < 1)
+        num_threads = 1;
+
+    enb_decode_job job[ENB_DECODE_MAX_THREADS];
+    for (int32_t i = 0; i < num_threads; i++) {
+        uint32_t first_block = (uint32_t)((uint64_t)block_count * i / num_threads);
+        uint32_t last_block = (uint32_t)((uint64_t)block_count * (i + 1) / num_threads);
+        job[i].source = anim_ctx;
+        job[i].data_out = data_out;
+        job[i].first_sample = first_block * interval;
+        job[i].last_sample = last_block * interval < sample_count ? last_block * interval : sample_count;
+        job[i].result = 0;
+    }
+
+    enb_run_jobs(enb_decode_thread, job, num_threads, sizeof(enb_decode_job));
+
+    enb_free(&anim_ctx);
+    for (int32_t i = 0; i < num_threads; i++)
+        if (job[i].result)
+            return job[i].result;
+    return 0;
+}
+
+int32_t enb_get_sample_count(enb_anim_context* anim_ctx) {
+    if (!anim_ctx)
+        return -1;
+
+    return anim_ctx->sample_count;
+}
+
+int32_t enb_seek_sample(enb_anim_context* anim_ctx, uint32_t sample) {
+    if (!anim_ctx)
+        return -1;
+    else if (sample >= anim_ctx->sample_count)
+        return -2;
+
+    if (anim_ctx->requested_time == -1.0f || anim_ctx->data.current_sample != sample)
+        enb_set_sample(anim_ctx, sample);
+    return sample;
+}
+
+int32_t enb_step_forward(enb_anim_context* anim_ctx) {
+    if (!anim_ctx)
+        return -1;
+
+    // A fresh context holds sample -1, so the first step lands on sample 0
+    if (anim_ctx->requested_time == -1.0f)
+        return enb_seek_sample(anim_ctx, 0);
+    return enb_seek_sample(anim_ctx, anim_ctx->data.current_sample + 1);
+}
+
+int32_t enb_step_backward(enb_anim_context* anim_ctx) {
+    if (!anim_ctx)
+        return -1;
+    else if (anim_ctx->requested_time == -1.0f || !anim_ctx->data.current_sample)
+        return -2;
+
+    return enb_seek_sample(anim_ctx, anim_ctx->data.current_sample - 1);
+}
+
+int32_t enb_get_static_tracks(enb_anim_context* anim_ctx, uint8_t* static_tracks) {
+    if (!anim_ctx)
+        return -1;
+
+    if (static_tracks)
+        memcpy(static_tracks, anim_ctx->static_track, anim_ctx->data.stream->track_count);
+    return anim_ctx->static_track_count;
+}
+
+int32_t enb_set_track_mask(enb_anim_context* anim_ctx, const uint8_t* track_mask) {
+    if (!anim_ctx)
+        return -1;
+
+    const uint32_t track_count = anim_ctx->data.stream->track_count;
+    if (!track_mask) {
+        free(anim_ctx->track_mask);
+        anim_ctx->track_mask = 0;
+        enb_invalidate_time(anim_ctx);
+        return 0;
+    }
+
+    if (!anim_ctx->track_mask) {
+        anim_ctx->track_mask = (uint8_t*)malloc(track_count);
+        if (!anim_ctx->track_mask)
+            return -2;
+        memset(anim_ctx->track_mask, 0, track_count);
+    }
+
+    // Masked out tracks stop updating their poses, so turning one back on has to replay from the start
+    for (uint32_t i = 0; i < track_count; i++) {
+        uint8_t enabled = track_mask[i] ? 1 : 0;
+        if (enabled && !anim_ctx->track_mask[i])
+            enb_invalidate_time(anim_ctx);
+        anim_ctx->track_mask[i] = enabled;
+    }
+    return 0;
+}
+
+int32_t enb_encode_data(quat_trans* track_data, int32_t* track_data_count, int32_t num_tracks,
+    int32_t num_components, float_t duration, int32_t sample_rate, float_t quantization_error,
+    quat_trans_interp_method quat_method, quat_trans_interp_method trans_method,
+    uint8_t** data_out, size_t* data_out_len) {
+    enb_encode_options options;
+    memset(&options, 0, sizeof(enb_encode_options));
+    options.rotation_quantization_error = quantization_error;
+    options.translation_quantization_error = quantization_error;
+    return enb_encode_data_ex(track_data, track_data_count, num_tracks, num_components, duration,
+        sample_rate, &options, quat_method, trans_method, data_out, data_out_len);
+}
+
+int32_t enb_encode_data_ex(quat_trans* track_data, int32_t* track_data_count, int32_t num_tracks,
+    int32_t num_components, float_t duration, int32_t sample_rate, const enb_encode_options* options,
+    quat_trans_interp_method quat_method, quat_trans_interp_method trans_method,
+    uint8_t** data_out, size_t* data_out_len) {
+    if (num_components != 7)
+        return -1;
+    else if (!options)
+        return -2;
+    else if (num_tracks < 1 || num_tracks > 300)
+        return -3;
+
+    enb_plain_animation plain_anim;
+    enb_plain_anim_init(&plain_anim);
+    enb_plain_anim_prepare_data(&plain_anim, track_data, track_data_count, num_tracks,
+        7, duration, sample_rate, options, quat_method, trans_method);
+    *data_out = 0;
+    *data_out_len = 0;
+    enb_plain_anim_write_data(&plain_anim, num_tracks, 7, duration, data_out, data_out_len);
+    enb_plain_anim_free(&plain_anim);
+    return *data_out ? 0 : -4;
+}
+
+int32_t enb_encode_begin(int32_t num_tracks, int32_t num_components, int32_t sample_rate,
+    float_t quantization_error, quat_trans_interp_method quat_method, quat_trans_interp_method trans_method,
+    enb_encode_context** enc_ctx) {
+    enb_encode_options options;
+    memset(&options, 0, sizeof(enb_encode_options));
+    options.rotation_quantization_error = quantization_error;
+    options.translation_quantization_error = quantization_error;
+    return enb_encode_begin_ex(num_tracks, num_components, sample_rate,
+        &options, quat_method, trans_method, enc_ctx);
+}
+
+int32_t enb_encode_begin_ex(int32_t num_tracks, int32_t num_components, int32_t sample_rate,
+    const enb_encode_options* options, quat_trans_interp_method quat_method, quat_trans_interp_method trans_method,
+    enb_encode_context** enc_ctx) {
+    if (!enc_ctx)
+        return -1;
+    *enc_ctx = 0;
+
+    if (num_components != 7 || !options)
+        return -2;
+    else if (num_tracks < 1 || num_tracks > 300 || sample_rate < 1)
+        return -3;
+    else if (options->signature & ENB_SIGNATURE_BATCH_ONLY)
+        return -6;
+
+    enb_encode_context* ec = (enb_encode_context*)malloc(sizeof(enb_encode_context));
+    if (!ec)
+        return -4;
+
+    memset((void*)ec, 0, sizeof(enb_encode_context));
+
+    const int32_t num_comps = num_tracks * 7;
+    enb_plain_anim_init(&ec->plain_anim);
+    ec->plain_anim.track_count = num_tracks;
+    ec->plain_anim.num_components = 7;
+    ec->plain_anim.sample_rate = sample_rate;
+    enb_plain_anim_set_quantization(&ec->plain_anim, num_tracks, options);
+    ec->quat_method = quat_method;
+    ec->trans_method = trans_method;
+    ec->min_range_size = 9;
+    ec->pending_sample = -1;
+
+    ec->prev_frame = (quat_trans*)calloc(num_tracks, sizeof(quat_trans));
+    ec->last_frame = (quat_trans*)calloc(num_tracks, sizeof(quat_trans));
+    ec->data = (quat_trans_int*)calloc(num_tracks, sizeof(quat_trans_int));
+    ec->pending_data = (quat_trans_int*)calloc(num_tracks, sizeof(quat_trans_int));
+    ec->prev_data = (int32_t*)calloc(num_comps, sizeof(int32_t));
+    ec->prev_delta = (int32_t*)calloc(num_comps, sizeof(int32_t));
+    ec->range_size = (int32_t*)calloc(num_comps, sizeof(int32_t));
+    ec->set_no_value = (bool*)calloc(num_comps, sizeof(bool));
+    ec->values = (int32_t*)calloc((size_t)num_comps * ENB_ENCODE_WINDOW, sizeof(int32_t));
+    ec->has_value = (bool*)calloc((size_t)num_comps * ENB_ENCODE_WINDOW, sizeof(bool));
+    ec->prev_has_value = (bool*)calloc(num_comps, sizeof(bool));
+    ec->track_flags = (uint8_t*)calloc(num_tracks, sizeof(uint8_t));
+
+    enb_arena_init(&ec->arena);
+    enb_anim_track_init_stream_init(&ec->track_data_init_stream, &ec->arena);
+    enb_anim_track_stream_init(&ec->track_data_stream, &ec->arena);
+    enb_anim_state_stream_init(&ec->state_data_stream, &ec->arena);
+
+    if (!ec->prev_frame || !ec->last_frame || !ec->data || !ec->pending_data
+        || !ec->prev_data || !ec->prev_delta || !ec->range_size || !ec->set_no_value
+        || !ec->values || !ec->has_value || !ec->prev_has_value || !ec->track_flags) {
+        enb_encode_free(&ec);
+        return -5;
+    }
+
+    for (int32_t i = 0; i < num_comps; i++)
+        ec->set_no_value[i] = true;
+
+    *enc_ctx = ec;
+    return 0;
+}
+
+int32_t enb_encode_push_frames(enb_encode_context* enc_ctx, quat_trans* frames, int32_t num_frames) {
+    if (!enc_ctx)
+        return -1;
+    else if (!frames && num_frames)
+        return -2;
+
+    const int32_t num_tracks = enc_ctx->plain_anim.track_count;
+    const float_t seconds_per_sample = 1.0f / (float_t)enc_ctx->plain_anim.sample_rate;
+
+    for (int32_t i = 0; i < num_frames; i++, frames += num_tracks) {
+        quat_trans* temp = enc_ctx->prev_frame;
+        enc_ctx->prev_frame = enc_ctx->last_frame;
+        enc_ctx->last_frame = temp;
+
+        memcpy(enc_ctx->last_frame, frames, sizeof(quat_trans) * num_tracks);
+        float_t frame_time = enc_ctx->last_frame[0].time;
+
+        if (!enc_ctx->num_frames++) {
+            for (int32_t j = 0; j < num_tracks; j++)
+                enb_plain_anim_get_data(&enc_ctx->plain_anim, &enc_ctx->data[j], &enc_ctx->last_frame[j], j);
+            enb_encode_context_put_sample(enc_ctx, enc_ctx->data);
+            enc_ctx->next_sample = 1;
+            continue;
+        }
+
+        for (int32_t j = 0; j < num_tracks; j++)
+            enc_ctx->plain_anim.num_rotation_flips += enb_anim_track_data_flip_rotation_pair(
+                &enc_ctx->prev_frame[j], &enc_ctx->last_frame[j]);
+
+        int32_t last_sample = (int32_t)(frame_time / seconds_per_sample);
+        if (enc_ctx->pending_sample >= 0 && enc_ctx->pending_sample <= last_sample) {
+            enb_encode_context_put_sample(enc_ctx, enc_ctx->pending_data);
+            enc_ctx->pending_sample = -1;
+        }
+
+        while (true) {
+            float_t time = (float_t)enc_ctx->next_sample * seconds_per_sample;
+            if (time > frame_time)
+                break;
+
+            if (enc_ctx->next_sample <= last_sample) {
+                enb_encode_context_resample(enc_ctx, enc_ctx->prev_frame,
+                    enc_ctx->last_frame, time, enc_ctx->data);
+                enb_encode_context_put_sample(enc_ctx, enc_ctx->data);
+            }
+            else {
+                enb_encode_context_resample(enc_ctx, enc_ctx->prev_frame,
+                    enc_ctx->last_frame, time, enc_ctx->pending_data);
+                enc_ctx->pending_sample = enc_ctx->next_sample;
+            }
+            enc_ctx->next_sample++;
+        }
+    }
+    return 0;
+}
+
+int32_t enb_encode_finish(enb_encode_context* enc_ctx, uint8_t** data_out, size_t* data_out_len) {
+    if (!enc_ctx)
+        return -1;
+    else if (!data_out)
+        return -2;
+    else if (!data_out_len)
+        return -3;
+    else if (!enc_ctx->num_frames)
+        return -4;
+
+    const int32_t num_tracks = enc_ctx->plain_anim.track_count;
+    const int32_t num_comps = num_tracks * 7;
+    const float_t seconds_per_sample = 1.0f / (float_t)enc_ctx->plain_anim.sample_rate;
+    const float_t duration = enc_ctx->last_frame[0].time;
+
+    int32_t last_sample = (int32_t)(duration / seconds_per_sample);
+    if (enc_ctx->pending_sample >= 0 && enc_ctx->pending_sample <= last_sample) {
+        enb_encode_context_put_sample(enc_ctx, enc_ctx->pending_data);
+        enc_ctx->pending_sample = -1;
+    }
+
+    while (enc_ctx->num_frames > 1 && enc_ctx->num_samples <= last_sample) {
+        float_t time = (float_t)enc_ctx->num_samples * seconds_per_sample;
+        enb_encode_context_resample(enc_ctx, enc_ctx->prev_frame,
+            enc_ctx->last_frame, time, enc_ctx->data);
+        enb_encode_context_put_sample(enc_ctx, enc_ctx->data);
+    }
+
+    for (int32_t j = 0; j < num_tracks; j++)
+        enb_plain_anim_get_data(&enc_ctx->plain_anim, &enc_ctx->data[j], &enc_ctx->last_frame[j], j);
+    enb_encode_context_put_sample(enc_ctx, enc_ctx->data);
+
+    const int32_t min_range_size = enc_ctx->min_range_size;
+    for (int32_t i = 0; i < num_comps; i++) {
+        int32_t range_size = enc_ctx->range_size[i];
+        int32_t max_range_size = enc_ctx->set_no_value[i] ? min_range_size / 2 : min_range_size;
+        if (range_size && range_size <= max_range_size
+            && (range_size > min_range_size / 2 || enc_ctx->set_no_value[i]))
+            enb_encode_context_drop_range(enc_ctx, i, enc_ctx->num_samples - range_size, range_size);
+    }
+
+    while (enc_ctx->num_written_samples < enc_ctx->num_samples)
+        enb_encode_context_write_sample(enc_ctx, enc_ctx->num_written_samples++);
+
+    enb_anim_state_stream_put_value(&enc_ctx->state_data_stream, enc_ctx->step + 100);
+
+    enb_byte_stream track_flags_byte_stream;
+    enb_byte_stream_init(&track_flags_byte_stream);
+    enb_byte_stream_alloc(&track_flags_byte_stream, num_tracks);
+    if (enb_byte_stream_get_data(&track_flags_byte_stream))
+        memcpy(enb_byte_stream_get_data(&track_flags_byte_stream), enc_ctx->track_flags, num_tracks);
+
+    *data_out = 0;
+    *data_out_len = 0;
+    enb_anim_stream_encoder_output(&enc_ctx->track_data_init_stream, &enc_ctx->track_data_stream,
+        &enc_ctx->state_data_stream, &track_flags_byte_stream, num_tracks, duration,
+        &enc_ctx->plain_anim, data_out, data_out_len);
+    enb_byte_stream_free(&track_flags_byte_stream);
+    return *data_out ? 0 : -5;
+}
+
+int32_t enb_encode_get_rotation_flips(enb_encode_context* enc_ctx) {
+    if (!enc_ctx)
+        return -1;
+
+    return enc_ctx->plain_anim.num_rotation_flips;
+}
+
+void enb_encode_free(enb_encode_context** enc_ctx) {
+    if (!enc_ctx || !*enc_ctx)
+        return;
+
+    enb_encode_context* ec = *enc_ctx;
+    enb_anim_state_stream_free(&ec->state_data_stream);
+    enb_anim_track_stream_free(&ec->track_data_stream);
+    enb_anim_track_init_stream_free(&ec->track_data_init_stream);
+    enb_arena_free(&ec->arena);
+    free(ec->track_flags);
+    free(ec->prev_has_value);
+    free(ec->has_value);
+    free(ec->values);
+    free(ec->set_no_value);
+    free(ec->range_size);
+    free(ec->prev_delta);
+    free(ec->prev_data);
+    free(ec->pending_data);
+    free(ec->data);
+    free(ec->last_frame);
+    free(ec->prev_frame);
+    free(*enc_ctx);
+    *enc_ctx = 0;
+}
+
+int32_t enb_verify_data(quat_trans* track_data, int32_t* track_data_count, int32_t num_tracks,
+    int32_t num_components, float_t duration, int32_t sample_rate, const enb_encode_options* options,
+    quat_trans_interp_method quat_method, quat_trans_interp_method trans_method,
+    int32_t num_threads, enb_verify_result* result) {
+    if (!track_data || !track_data_count || !options)
+        return -1;
+    else if (!result)
+        return -2;
+    else if (num_components != 7 || num_tracks < 1 || num_tracks > 300 || sample_rate < 1)
+        return -3;
+
+    memset(result, 0, sizeof(enb_verify_result));
+
+    uint8_t* data = 0;
+    size_t data_len = 0;
+    enb_plain_animation plain_anim;
+    enb_plain_anim_init(&plain_anim);
+    enb_plain_anim_prepare_data(&plain_anim, track_data, track_data_count, num_tracks,
+        7, duration, sample_rate, options, quat_method, trans_method);
+    enb_plain_anim_write_data(&plain_anim, num_tracks, 7, duration, &data, &data_len);
+    result->rotation_flips = plain_anim.num_rotation_flips;
+    enb_plain_anim_free(&plain_anim);
+    if (!data)
+        return -4;
+
+    enb_anim_stream* anim_stream = (enb_anim_stream*)data;
+    const uint32_t* section_length = &anim_stream->track_data_init_i2_length;
+    for (int32_t i = 0; i < ENB_SECTION_COUNT; i++)
+        result->section_length[i] = section_length[i];
+    result->data_len = data_len;
+
+    float_t seconds_per_sample = 1.0f / (float_t)sample_rate;
+    int32_t num_samples = (int32_t)(duration / seconds_per_sample) + 2;
+
+    enb_anim_context* anim_ctx = 0;
+    quat_trans* decoded = (quat_trans*)malloc(sizeof(quat_trans) * num_tracks * num_samples);
+    int32_t* track_data_offset = (int32_t*)malloc(sizeof(int32_t) * num_tracks);
+    result->track_error = (enb_track_error*)calloc(num_tracks, sizeof(enb_track_error));
+    if (!decoded || !track_data_offset || !result->track_error || enb_initialize(data, &anim_ctx)) {
+        free(track_data_offset);
+        free(decoded);
+        free(data);
+        enb_verify_free(result);
+        return -5;
+    }
+
+    for (int32_t i = 0, j = 0; i < num_tracks; i++) {
+        track_data_offset[i] = j;
+        j += track_data_count[i];
+    }
+
+    // The decoder only steps sequentially, so decode once and spread the metrics across threads
+    quat_trans* qt_data = decoded;
+    for (int32_t i = 0; i < num_samples; i++) {
+        float_t time = (float_t)i * seconds_per_sample;
+        if (time > duration)
+            time = duration;
+
+        for (int32_t j = 0; j < num_tracks; j++, qt_data++)
+            enb_get_component_values(anim_ctx, time, j, qt_data, quat_method, trans_method);
+    }
+    enb_free(&anim_ctx);
+
+    if (num_threads > num_tracks)
+        num_threads = num_tracks;
+    if (num_threads > ENB_VERIFY_MAX_THREADS)
+        num_threads = ENB_VERIFY_MAX_THREADS;
+    else if (num_threads < 1)
+        num_threads = 1;
+
+    enb_verify_job job[ENB_VERIFY_MAX_THREADS];
+    for (int32_t i = 0; i < num_threads; i++) {
+        job[i].track_data = track_data;
+        job[i].track_data_offset = track_data_offset;
+        job[i].track_data_count = track_data_count;
+        job[i].decoded = decoded;
+        job[i].num_tracks = num_tracks;
+        job[i].num_samples = num_samples;
+        job[i].seconds_per_sample = seconds_per_sample;
+        job[i].duration = duration;
+        job[i].quat_method = quat_method;
+        job[i].trans_method = trans_method;
+        job[i].first_track = i;
+        job[i].track_step = num_threads;
+        job[i].track_error = result->track_error;
+    }
+
+    enb_run_jobs(enb_verify_thread, job, num_threads, sizeof(enb_verify_job));
+
+    double_t rotation_sum = 0.0;
+    double_t translation_sum = 0.0;
+    for (int32_t i = 0; i < num_tracks; i++) {
+        enb_track_error* track_error = &result->track_error[i];
+        if (result->error.rotation_max_error < track_error->rotation_max_error)
+            result->error.rotation_max_error = track_error->rotation_max_error;
+        if (result->error.translation_max_error < track_error->translation_max_error)
+            result->error.translation_max_error = track_error->translation_max_error;
+        rotation_sum += (double_t)track_error->rotation_rms_error * track_error->rotation_rms_error;
+        translation_sum += (double_t)track_error->translation_rms_error * track_error->translation_rms_error;
+    }
+
+    result->error.rotation_rms_error = (float_t)sqrt(rotation_sum / num_tracks);
+    result->error.translation_rms_error = (float_t)sqrt(translation_sum / num_tracks);
+    result->track_count = num_tracks;
+    result->sample_count = num_samples;
+
+    free(track_data_offset);
+    free(decoded);
+    free(data);
+    return 0;
+}
+
+void enb_verify_free(enb_verify_result* result) {
+    if (!result)
+        return;
+
+    free(result->track_error);
+    memset(result, 0, sizeof(enb_verify_result));
+}
+
+static void enb_get_track_data(enb_anim_context* anim_ctx, int32_t track_id,
+    quat_trans** prev, quat_trans** next, float_t time) { // 0x08A8C34
+    if (time < anim_ctx->data.previous_sample_time
+        || time > anim_ctx->data.current_sample_time)
+        enb_set_time(anim_ctx, time);
+
+    *next = enb_get_track_data_next(anim_ctx, track_id);
+    *prev = enb_get_track_data_prev(anim_ctx, track_id);
+}
+
+static quat_trans* enb_get_track_data_next(enb_anim_context* anim_ctx, int32_t track_id) {
+    return &anim_ctx->data.track[track_id].qt[anim_ctx->track_selector & 0x01];
+}
+
+static quat_trans* enb_get_track_data_prev(enb_anim_context* anim_ctx, int32_t track_id) {
+    return &anim_ctx->data.track[track_id].qt[(anim_ctx->track_selector & 0x01) ^ 0x01];
+}
+
+// Returns the clamped blend between the poses around time. Static tracks keep their initial pose, so once
+// decoded they need no seek and come back as prev == next with a blend of 1
+static float_t enb_get_track_pair(enb_anim_context* anim_ctx, int32_t track_id, float_t time,
+    const quat_trans** prev, const quat_trans** next) {
+    quat_trans* p = 0;
+    quat_trans* n = 0;
+    const bool is_static = anim_ctx->static_track[track_id];
+
+    if (!is_static || anim_ctx->requested_time == -1.0f)
+        enb_get_track_data(anim_ctx, track_id, &p, &n, time);
+
+    *next = enb_get_track_data_next(anim_ctx, track_id);
+    if (is_static) {
+        *prev = *next;
+        return 1.0f;
+    }
+
+    *prev = enb_get_track_data_prev(anim_ctx, track_id);
+    const float_t blend = (time - (*prev)->time) / enb_get_sample_interval((*prev)->time,
+        anim_ctx->seconds_per_sample, anim_ctx->data.stream->duration);
+    return blend > 1.0f ? 1.0f : blend < 0.0f ? 0.0f : blend;
+}
+
+// The last sample sits at the clip end, so the final interval is shorter when the duration isn't a whole sample
+static float_t enb_get_sample_interval(float_t prev_time, float_t seconds_per_sample, float_t duration) {
+    const float_t interval = duration - prev_time;
+    return interval > 0.0f && interval < seconds_per_sample ? interval : seconds_per_sample;
+}
+
+static void enb_init(enb_anim_context* anim_ctx, enb_anim_stream* anim_stream) { // 0x08A08050 in ULJM05681
+    uint8_t* data;
+    uint32_t temp;
+
+    data = (uint8_t*)anim_stream;
+    anim_ctx->data.current_sample = -1;
+    anim_ctx->data.current_sample_time = -1.0f;
+    anim_ctx->data.previous_sample_time = -1.0f;
+    anim_ctx->requested_time = -1.0f;
+    anim_ctx->seconds_per_sample = 1.0f / (float_t)anim_stream->sample_rate;
+    anim_ctx->track_direction = 0;
+
+    anim_ctx->data.data_length = enb_anim_stream_get_length(anim_stream);
+    anim_ctx->track_flags = enb_anim_stream_get_track_flags(anim_stream);
+    anim_ctx->track_data_init.i2 = (const uint8_t*)enb_anim_stream_get_track_data_init_i2(anim_stream);
+    anim_ctx->track_data_init.i8 = (const int8_t*)enb_anim_stream_get_track_data_init_i8(anim_stream);
+    anim_ctx->track_data_init.i16 = (const int16_t*)enb_anim_stream_get_track_data_init_i16(anim_stream);
+    anim_ctx->track_data_init.i32 = (const int32_t*)enb_anim_stream_get_track_data_init_i32(anim_stream);
+    anim_ctx->track_data.i2 = (const uint8_t*)enb_anim_stream_get_track_data_i2(anim_stream);
+    anim_ctx->track_data.i4 = (const uint8_t*)enb_anim_stream_get_track_data_i4(anim_stream);
+    anim_ctx->track_data.i8 = (const int8_t*)enb_anim_stream_get_track_data_i8(anim_stream);
+    anim_ctx->track_data.i16 = (const int16_t*)enb_anim_stream_get_track_data_i16(anim_stream);
+    anim_ctx->track_data.i32 = (const int32_t*)enb_anim_stream_get_track_data_i32(anim_stream);
+    anim_ctx->state_data.u2 = enb_anim_stream_get_state_data_u2(anim_stream);
+    anim_ctx->state_data.u8 = enb_anim_stream_get_state_data_u8(anim_stream);
+    anim_ctx->state_data.u16 = (const uint16_t*)enb_anim_stream_get_state_data_u16(anim_stream);
+    anim_ctx->state_data.u32 = (const uint32_t*)enb_anim_stream_get_state_data_u32(anim_stream);
+    anim_ctx->state_data.u8 = enb_anim_stream_get_state_data_u8(anim_stream);
+    anim_ctx->state_data.u8 = enb_anim_stream_get_state_data_u8(anim_stream);
+
+    if (anim_stream->signature & ENB_SIGNATURE_SPLIT_QUANTIZATION) {
+        anim_ctx->rotation_quantization_error = enb_anim_stream_get_quantization(anim_stream);
+        anim_ctx->translation_quantization_error
+            = &anim_ctx->rotation_quantization_error[anim_stream->track_count];
+    }
+    else {
+        anim_ctx->rotation_quantization_error = 0;
+        anim_ctx->translation_quantization_error = 0;
+    }
+
+    if (anim_stream->signature & ENB_SIGNATURE_SMALLEST_THREE)
+        anim_ctx->dropped_component = enb_anim_stream_get_dropped_components(anim_stream);
+    else
+        anim_ctx->dropped_component = 0;
+
+    // Only streams that actually use order 0/1 predictors need the trailing reader to step backward
+    anim_ctx->predictor = 0;
+    if (anim_stream->signature & ENB_SIGNATURE_PREDICTOR) {
+        const uint16_t* predictor = enb_anim_stream_get_predictors(anim_stream);
+        for (uint32_t i = 0; i < anim_stream->track_count; i++)
+            if (predictor[i]) {
+                anim_ctx->predictor = predictor;
+                break;
+            }
+    }
+
+    enb_init_decoder(anim_ctx);
+}
+
+static void enb_init_decoder(enb_anim_context* anim_ctx) { // 0x08A07FD0 in ULJM05681
+    anim_ctx->track_data_init_dec.i2 = anim_ctx->track_data_init.i2;
+    anim_ctx->track_data_init_dec.i8 = anim_ctx->track_data_init.i8;
+    anim_ctx->track_data_init_dec.i16 = anim_ctx->track_data_init.i16;
+    anim_ctx->track_data_init_dec.i32 = anim_ctx->track_data_init.i32;
+    anim_ctx->track_data_init_dec.i2_counter = 0;
+
+    anim_ctx->track_data_dec.i2 = anim_ctx->track_data.i2;
+    anim_ctx->track_data_dec.i4 = anim_ctx->track_data.i4;
+    anim_ctx->track_data_dec.i8 = anim_ctx->track_data.i8;
+    anim_ctx->track_data_dec.i16 = anim_ctx->track_data.i16;
+    anim_ctx->track_data_dec.i32 = anim_ctx->track_data.i32;
+    anim_ctx->track_data_dec.i2_counter = 0;
+    anim_ctx->track_data_dec.i4_counter = 0;
+
+    anim_ctx->state_data_dec.u2 = anim_ctx->state_data.u2;
+    anim_ctx->state_data_dec.u8 = anim_ctx->state_data.u8;
+    anim_ctx->state_data_dec.u16 = anim_ctx->state_data.u16;
+    anim_ctx->state_data_dec.u32 = anim_ctx->state_data.u32;
+    anim_ctx->state_data_dec.u2_counter = 0;
+
+    if (anim_ctx->rans)
+        anim_ctx->rans->position = 0;
+}
+
+static void enb_find_static_tracks(enb_anim_context* anim_ctx) {
+    enb_anim_stream* anim_stream = anim_ctx->data.stream;
+    const int32_t track_count = anim_stream->track_count;
+    const float_t sps = anim_ctx->seconds_per_sample;
+    enb_track* track = anim_ctx->data.track;
+    uint8_t* static_track = anim_ctx->static_track;
+
+    for (int32_t i = 0; i < track_count; i++) {
+        track[i].flags = anim_ctx->track_flags[i];
+        static_track[i] = !track[i].flags;
+
+        // Order 0 components rebuild from their residuals alone, so an empty residual is not a constant
+        if (anim_ctx->predictor)
+            for (int32_t j = 0; j < 7; j++)
+                if (ENB_PREDICTOR_GET(anim_ctx->predictor[i], j) == ENB_PREDICTOR_ORDER_0)
+                    static_track[i] = 0;
+    }
+
+    // Walks the state stream the way enb_set_time does and drops every track that ever gets a flag
+    enb_anim_state state;
+    enb_anim_state_data_decoder state_data = anim_ctx->state_data_dec;
+    enb_state_step_init(&state, &state_data);
+    uint32_t i = 1;
+    for (; anim_stream->duration - i * sps > 0.00001f; i++) {
+        enb_state_step_forward(&state, track, track_count, &state_data);
+        for (int32_t j = 0; j < track_count; j++)
+            if (track[j].flags)
+                static_track[j] = 0;
+    }
+    anim_ctx->sample_count = anim_stream->duration > 0.00001f ? i + 1 : 1;
+
+    anim_ctx->static_track_count = 0;
+    for (int32_t i = 0; i < track_count; i++) {
+        anim_ctx->static_track_count += static_track[i];
+        track[i].flags = 0;
+    }
+}
+
+static void enb_invalidate_time(enb_anim_context* anim_ctx) {
+    anim_ctx->data.current_sample = -1;
+    anim_ctx->data.current_sample_time = -1.0f;
+    anim_ctx->data.previous_sample_time = -1.0f;
+    anim_ctx->requested_time = -1.0f;
+    anim_ctx->seek_pending = 0;
+    anim_ctx->seek_pose_time = -1.0f;
+}
+
+static int enb_time_query_compare(const void* a, const void* b) {
+    const enb_time_query* qa = (const enb_time_query*)a;
+    const enb_time_query* qb = (const enb_time_query*)b;
+
+    if (qa->time != qb->time)
+        return qa->time < qb->time ? -1 : 1;
+    return qa->index - qb->index;
+}
+
+static int enb_instance_query_compare(const void* a, const void* b) {
+    const enb_instance_query* qa = (const enb_instance_query*)a;
+    const enb_instance_query* qb = (const enb_instance_query*)b;
+
+    if (qa->stream != qb->stream)
+        return (uintptr_t)qa->stream < (uintptr_t)qb->stream ? -1 : 1;
+    else if (qa->time != qb->time)
+        return qa->time < qb->time ? -1 : 1;
+    return qa->index - qb->index;
+}
+
+static uint32_t enb_find_sample(enb_anim_context* anim_ctx, float_t time, float_t* blend) {
+    const uint32_t last_sample = anim_ctx->sample_count - 1;
+    const float_t sps = anim_ctx->seconds_per_sample;
+
+    // Picks the sample pair enb_set_time would land on
+    *blend = 0.0f;
+    if (time < 0.000001f || !last_sample)
+        return 0;
+
+    float_t sample_float = ceilf(time / sps);
+    uint32_t sample = sample_float < (float_t)last_sample ? (uint32_t)sample_float : last_sample;
+    while (sample > 1 && time <= (sample - 1) * sps)
+        sample--;
+    while (sample < last_sample && time > sample * sps)
+        sample++;
+    if (!sample)
+        sample = 1;
+
+    *blend = (time - (sample - 1) * sps) / enb_get_sample_interval((sample - 1) * sps,
+        sps, anim_ctx->data.stream->duration);
+    return sample;
+}
+
+static void enb_get_sample_pose(enb_anim_context* anim_ctx, bool next, quat_trans* pose) {
+    const int32_t track_count = anim_ctx->data.stream->track_count;
+    const float_t duration = anim_ctx->data.stream->duration;
+    const float_t sps = anim_ctx->seconds_per_sample;
+    const uint32_t current_sample = anim_ctx->data.current_sample;
+
+    float_t time;
+    if (next)
+        time = current_sample * sps < duration ? current_sample * sps : duration;
+    else
+        time = current_sample ? (current_sample - 1) * sps : 0.0f;
+
+    for (int32_t i = 0; i < track_count; i++) {
+        quat_trans* qt = next ? enb_get_track_data_next(anim_ctx, i) : enb_get_track_data_prev(anim_ctx, i);
+        pose[i].quat = qt->quat;
+        pose[i].trans = qt->trans;
+        pose[i].time = time;
+    }
+}
+
+static void enb_blend_sample(enb_anim_context* anim_ctx, uint32_t sample, float_t blend,
+    quat_trans* data, quat_trans_interp_method quat_method, quat_trans_interp_method trans_method) {
+    const int32_t track_count = anim_ctx->data.stream->track_count;
+    const float_t duration = anim_ctx->data.stream->duration;
+    const float_t sps = anim_ctx->seconds_per_sample;
+
+    if (anim_ctx->requested_time == -1.0f || anim_ctx->data.current_sample != sample)
+        enb_set_sample(anim_ctx, sample);
+
+    for (int32_t i = 0; i < track_count; i++) {
+        quat_trans prev = *enb_get_track_data_prev(anim_ctx, i);
+        quat_trans next = *enb_get_track_data_next(anim_ctx, i);
+        prev.time = sample ? (sample - 1) * sps : 0.0f;
+        next.time = sample * sps < duration ? sample * sps : duration;
+        interp_quat_trans(&prev, &next, &data[i], blend, quat_method, trans_method);
+    }
+}
+
+// Same blend as enb_get_component_values, done for the whole run before converting it
+static void enb_get_matrices_batch(enb_anim_context* anim_ctx, float_t time,
+    const int32_t* tracks, int32_t count, const vec3* scale, enb_matrix3x4* data,
+    quat_trans_interp_method quat_method, quat_trans_interp_method trans_method) {
+    const quat_trans* prev[ENB_MATRIX_BATCH];
+    const quat_trans* next[ENB_MATRIX_BATCH];
+    float_t blend[ENB_MATRIX_BATCH];
+    enb_matrix_batch batch;
+
+    for (int32_t i = 0; i < count; i++) {
+        blend[i] = enb_get_track_pair(anim_ctx, tracks[i], time, &prev[i], &next[i]);
+        enb_matrix_batch_put_scale(&batch, i, scale ? &scale[tracks[i]] : 0);
+    }
+
+    switch (quat_method) {
+    case QUAT_TRANS_INTERP_NONE:
+        for (int32_t i = 0; i < count; i++) {
+            batch.qx[i] = next[i]->quat.x;
+            batch.qy[i] = next[i]->quat.y;
+            batch.qz[i] = next[i]->quat.z;
+            batch.qw[i] = next[i]->quat.w;
+        }
+        break;
+    case QUAT_TRANS_INTERP_LERP:
+        for (int32_t i = 0; i < count; i++) {
+            const float_t b0 = blend[i];
+            const float_t b1 = 1.0f - blend[i];
+            batch.qx[i] = prev[i]->quat.x * b1 + next[i]->quat.x * b0;
+            batch.qy[i] = prev[i]->quat.y * b1 + next[i]->quat.y * b0;
+            batch.qz[i] = prev[i]->quat.z * b1 + next[i]->quat.z * b0;
+            batch.qw[i] = prev[i]->quat.w * b1 + next[i]->quat.w * b0;
+        }
+        break;
+    case QUAT_TRANS_INTERP_SLERP:
+        for (int32_t i = 0; i < count; i++) {
+            quat q = next[i]->quat;
+            if (prev[i] != next[i])
+                slerp_quat(&prev[i]->quat, &next[i]->quat, &q, blend[i]);
+            batch.qx[i] = q.x;
+            batch.qy[i] = q.y;
+            batch.qz[i] = q.z;
+            batch.qw[i] = q.w;
+        }
+        break;
+    }
+
+    if (trans_method == QUAT_TRANS_INTERP_NONE)
+        for (int32_t i = 0; i < count; i++) {
+            batch.tx[i] = next[i]->trans.x;
+            batch.ty[i] = next[i]->trans.y;
+            batch.tz[i] = next[i]->trans.z;
+        }
+    else
+        for (int32_t i = 0; i < count; i++) {
+            const float_t b0 = blend[i];
+            const float_t b1 = 1.0f - blend[i];
+            batch.tx[i] = prev[i]->trans.x * b1 + next[i]->trans.x * b0;
+            batch.ty[i] = prev[i]->trans.y * b1 + next[i]->trans.y * b0;
+            batch.tz[i] = prev[i]->trans.z * b1 + next[i]->trans.z * b0;
+        }
+
+    enb_matrix_batch_convert(&batch, count, data);
+}
+
+static void enb_matrix_batch_put_scale(enb_matrix_batch* batch, int32_t index, const vec3* scale) {
+    batch->sx[index] = scale ? scale->x : 1.0f;
+    batch->sy[index] = scale ? scale->y : 1.0f;
+    batch->sz[index] = scale ? scale->z : 1.0f;
+}
+
+// M = T * R * S, 2 / |q|^2 keeps lerped quaternions a pure rotation without normalizing them first.
+// FLT_MIN only changes a zero quaternion, which then gives a zero rotation without a branch in the loop
+static void enb_matrix_batch_convert(const enb_matrix_batch* batch, int32_t count, enb_matrix3x4* data) {
+    for (int32_t i = 0; i < count; i++) {
+        const float_t x = batch->qx[i];
+        const float_t y = batch->qy[i];
+        const float_t z = batch->qz[i];
+        const float_t w = batch->qw[i];
+        const float_t s = 2.0f / (x * x + y * y + z * z + w * w + FLT_MIN);
+
+        const float_t xx = x * x * s;
+        const float_t yy = y * y * s;
+        const float_t zz = z * z * s;
+        const float_t xy = x * y * s;
+        const float_t xz = x * z * s;
+        const float_t yz = y * z * s;
+        const float_t wx = w * x * s;
+        const float_t wy = w * y * s;
+        const float_t wz = w * z * s;
+
+        float_t* m = &data[i].m[0][0];
+        m[0] = (1.0f - (yy + zz)) * batch->sx[i];
+        m[1] = (xy - wz) * batch->sy[i];
+        m[2] = (xz + wy) * batch->sz[i];
+        m[3] = batch->tx[i];
+        m[4] = (xy + wz) * batch->sx[i];
+        m[5] = (1.0f - (xx + zz)) * batch->sy[i];
+        m[6] = (yz - wx) * batch->sz[i];
+        m[7] = batch->ty[i];
+        m[8] = (xz - wy) * batch->sx[i];
+        m[9] = (yz + wx) * batch->sy[i];
+        m[10] = (1.0f - (xx + yy)) * batch->sz[i];
+        m[11] = batch->tz[i];
+    }
+}
+
+#ifdef _WIN32
+static DWORD WINAPI enb_prefetch_thread(LPVOID arg) {
+#else
+static void* enb_prefetch_thread(void* arg) {
+#endif
+    enb_prefetch* prefetch = (enb_prefetch*)arg;
+    enb_anim_context* anim_ctx = prefetch->producer_ctx;
+    const int32_t track_count = prefetch->track_count;
+    uint32_t generation = 0;
+    uint32_t sample = 0;
+
+    while (!__atomic_load_n(&prefetch->stop, __ATOMIC_SEQ_CST)) {
+        uint32_t seek_generation = __atomic_load_n(&prefetch->seek_generation, __ATOMIC_ACQUIRE);
+        if (generation != seek_generation) {
+            generation = seek_generation;
+            sample = __atomic_load_n(&prefetch->seek_sample, __ATOMIC_RELAXED);
+        }
+
+        if (!enb_prefetch_can_produce(prefetch, sample)) {
+            // The flag is set before the recheck so a notify in between can't be lost
+#ifdef _WIN32
+            EnterCriticalSection(&prefetch->lock);
+            __atomic_store_n(&prefetch->waiting, 1, __ATOMIC_SEQ_CST);
+            if (!__atomic_load_n(&prefetch->stop, __ATOMIC_SEQ_CST)
+                && generation == __atomic_load_n(&prefetch->seek_generation, __ATOMIC_SEQ_CST)
+                && !enb_prefetch_can_produce(prefetch, sample))
+                SleepConditionVariableCS(&prefetch->wake, &prefetch->lock, INFINITE);
+            __atomic_store_n(&prefetch->waiting, 0, __ATOMIC_SEQ_CST);
+            LeaveCriticalSection(&prefetch->lock);
+#else
+            pthread_mutex_lock(&prefetch->lock);
+            __atomic_store_n(&prefetch->waiting, 1, __ATOMIC_SEQ_CST);
+            if (!__atomic_load_n(&prefetch->stop, __ATOMIC_SEQ_CST)
+                && generation == __atomic_load_n(&prefetch->seek_generation, __ATOMIC_SEQ_CST)
+                && !enb_prefetch_can_produce(prefetch, sample))
+                pthread_cond_wait(&prefetch->wake, &prefetch->lock);
+            __atomic_store_n(&prefetch->waiting, 0, __ATOMIC_SEQ_CST);
+            pthread_mutex_unlock(&prefetch->lock);
+#endif
+            continue;
+        }
+
+        if (anim_ctx->requested_time == -1.0f || anim_ctx->data.current_sample != sample)
+            enb_set_sample(anim_ctx, sample);
+
+        const uint32_t head = prefetch->head;
+        const uint32_t index = head % prefetch->capacity;
+        enb_get_sample_pose(anim_ctx, true, &prefetch->pose[(size_t)index * track_count]);
+        prefetch->slot[index].generation = generation;
+        prefetch->slot[index].sample = sample++;
+        __atomic_store_n(&prefetch->head, head + 1, __ATOMIC_RELEASE);
+    }
+    return 0;
+}
+
+static bool enb_prefetch_can_produce(enb_prefetch* prefetch, uint32_t sample) {
+    const uint32_t tail = __atomic_load_n(&prefetch->tail, __ATOMIC_SEQ_CST);
+    return sample < prefetch->producer_ctx->sample_count && prefetch->head - tail < prefetch->capacity;
+}
+
+static void enb_prefetch_notify(enb_prefetch* prefetch) {
+    if (!__atomic_load_n(&prefetch->waiting, __ATOMIC_SEQ_CST))
+        return;
+
+#ifdef _WIN32
+    EnterCriticalSection(&prefetch->lock);
+    WakeConditionVariable(&prefetch->wake);
+    LeaveCriticalSection(&prefetch->lock);
+#else
+    pthread_mutex_lock(&prefetch->lock);
+    pthread_cond_signal(&prefetch->wake);
+    pthread_mutex_unlock(&prefetch->lock);
+#endif
+}
+
+static void enb_baked_put_pose(enb_baked_clip* baked, uint32_t sample, int32_t column, const quat_trans* pose) {
+    uint8_t* dst = baked->table + baked->row_size * sample + baked->pose_size * column;
+
+    if (baked->format == ENB_BAKE_FLOAT) {
+        float_t* value = (float_t*)dst;
+        value[0] = pose->quat.x;
+        value[1] = pose->quat.y;
+        value[2] = pose->quat.z;
+        value[3] = pose->quat.w;
+        value[4] = pose->trans.x;
+        value[5] = pose->trans.y;
+        value[6] = pose->trans.z;
+        return;
+    }
+
+    const vec3* min = &baked->trans_min[column];
+    const vec3* scale = &baked->trans_scale[column];
+    int16_t* value = (int16_t*)dst;
+    value[0] = (int16_t)lroundf(pose->quat.x * 32767.0f);
+    value[1] = (int16_t)lroundf(pose->quat.y * 32767.0f);
+    value[2] = (int16_t)lroundf(pose->quat.z * 32767.0f);
+    value[3] = (int16_t)lroundf(pose->quat.w * 32767.0f);
+    value[4] = (int16_t)(scale->x > 0.0f ? lroundf((pose->trans.x - min->x) / scale->x) - 0x8000 : -0x8000);
+    value[5] = (int16_t)(scale->y > 0.0f ? lroundf((pose->trans.y - min->y) / scale->y) - 0x8000 : -0x8000);
+    value[6] = (int16_t)(scale->z > 0.0f ? lroundf((pose->trans.z - min->z) / scale->z) - 0x8000 : -0x8000);
+}
+
+static void enb_baked_get_pose(const enb_baked_clip* baked, uint32_t sample, int32_t column, quat_trans* pose) {
+    const uint8_t* src = baked->table + baked->row_size * sample + baked->pose_size * column;
+
+    pose->time = sample * baked->seconds_per_sample;
+    if (baked->format == ENB_BAKE_FLOAT) {
+        const float_t* value = (const float_t*)src;
+        pose->quat = (quat){ value[0], value[1], value[2], value[3] };
+        pose->trans = (vec3){ value[4], value[5], value[6] };
+        return;
+    }
+
+    const vec3* min = &baked->trans_min[column];
+    const vec3* scale = &baked->trans_scale[column];
+    const int16_t* value = (const int16_t*)src;
+    pose->quat.x = value[0] * (1.0f / 32767.0f);
+    pose->quat.y = value[1] * (1.0f / 32767.0f);
+    pose->quat.z = value[2] * (1.0f / 32767.0f);
+    pose->quat.w = value[3] * (1.0f / 32767.0f);
+    pose->trans.x = min->x + (value[4] + 0x8000) * scale->x;
+    pose->trans.y = min->y + (value[5] + 0x8000) * scale->y;
+    pose->trans.z = min->z + (value[6] + 0x8000) * scale->z;
+}
+
+static void enb_pose_cache_lock(enb_pose_cache* cache) {
+#ifdef _WIN32
+    EnterCriticalSection(&cache->lock);
+#else
+    pthread_mutex_lock(&cache->lock);
+#endif
+}
+
+static void enb_pose_cache_unlock(enb_pose_cache* cache) {
+#ifdef _WIN32
+    LeaveCriticalSection(&cache->lock);
+#else
+    pthread_mutex_unlock(&cache->lock);
+#endif
+}
+
+static enb_pose_cache_entry** enb_pose_cache_get_bucket(enb_pose_cache* cache,
+    const enb_anim_stream* stream, uint32_t sample) {
+    uint32_t hash = (uint32_t)((uintptr_t)stream >> 4) * 0x9E3779B1u;
+    hash ^= sample * 0x85EBCA6Bu;
+    hash ^= hash >> 16;
+    return &cache->bucket[hash & (cache->bucket_count - 1)];
+}
+
+static enb_pose_cache_entry* enb_pose_cache_find(enb_pose_cache* cache,
+    const enb_anim_stream* stream, uint32_t sample) {
+    enb_pose_cache_entry* entry = *enb_pose_cache_get_bucket(cache, stream, sample);
+    while (entry && (entry->stream != stream || entry->sample != sample))
+        entry = entry->hash_next;
+    return entry;
+}
+
+static void enb_pose_cache_insert(enb_pose_cache* cache, enb_anim_context* anim_ctx, uint32_t sample, bool next) {
+    const enb_anim_stream* stream = anim_ctx->data.stream;
+    const int32_t track_count = stream->track_count;
+    const size_t size = sizeof(enb_pose_cache_entry) + sizeof(quat_trans) * track_count;
+
+    // Another thread may have decoded the same sample while the lock was released
+    if (size > cache->stats.memory_limit || enb_pose_cache_find(cache, stream, sample))
+        return;
+
+    while (cache->lru_tail && cache->stats.memory_used + size > cache->stats.memory_limit) {
+        enb_pose_cache_remove(cache, cache->lru_tail);
+        cache->stats.evictions++;
+    }
+
+    enb_pose_cache_entry* entry = (enb_pose_cache_entry*)malloc(size);
+    if (!entry)
+        return;
+
+    entry->stream = stream;
+    entry->sample = sample;
+    entry->track_count = track_count;
+    enb_get_sample_pose(anim_ctx, next, entry->pose);
+
+    enb_pose_cache_entry** bucket = enb_pose_cache_get_bucket(cache, stream, sample);
+    entry->hash_next = *bucket;
+    *bucket = entry;
+
+    entry->lru_prev = 0;
+    entry->lru_next = cache->lru_head;
+    if (cache->lru_head)
+        cache->lru_head->lru_prev = entry;
+    else
+        cache->lru_tail = entry;
+    cache->lru_head = entry;
+
+    cache->stats.memory_used += size;
+    cache->stats.entry_count++;
+}
+
+static void enb_pose_cache_remove(enb_pose_cache* cache, enb_pose_cache_entry* entry) {
+    enb_pose_cache_entry** bucket = enb_pose_cache_get_bucket(cache, entry->stream, entry->sample);
+    while (*bucket != entry)
+        bucket = &(*bucket)->hash_next;
+    *bucket = entry->hash_next;
+
+    if (entry->lru_prev)
+        entry->lru_prev->lru_next = entry->lru_next;
+    else
+        cache->lru_head = entry->lru_next;
+    if (entry->lru_next)
+        entry->lru_next->lru_prev = entry->lru_prev;
+    else
+        cache->lru_tail = entry->lru_prev;
+
+    cache->stats.memory_used -= sizeof(enb_pose_cache_entry) + sizeof(quat_trans) * entry->track_count;
+    cache->stats.entry_count--;
+    free(entry);
+}
+
+static void enb_pose_cache_touch(enb_pose_cache* cache, enb_pose_cache_entry* entry) {
+    if (cache->lru_head == entry)
+        return;
+
+    entry->lru_prev->lru_next = entry->lru_next;
+    if (entry->lru_next)
+        entry->lru_next->lru_prev = entry->lru_prev;
+    else
+        cache->lru_tail = entry->lru_prev;
+
+    entry->lru_prev = 0;
+    entry->lru_next = cache->lru_head;
+    cache->lru_head->lru_prev = entry;
+    cache->lru_head = entry;
+}
+
+static void enb_set_time(enb_anim_context* anim_ctx, float_t time) { // 0x08A0876C in ULJM05681
+    float_t quantization_error;
+    float_t requested_time;
+    float_t sps; // seconds per sample
+    int32_t restart;
+
+    if (time == anim_ctx->requested_time)
+        return;
+
+    quantization_error = enb_get_quantization_error(anim_ctx);
+    requested_time = anim_ctx->requested_time;
+    sps = anim_ctx->seconds_per_sample;
+
+    restart = -1;
+    if (anim_ctx->restart && (time >= 0.000001f)) {
+        float_t blend;
+        restart = enb_find_restart(anim_ctx, enb_find_sample(anim_ctx, time, &blend));
+    }
+
+    if (restart >= 0)
+        enb_restore_restart(anim_ctx, restart);
+    else if ((requested_time == -1.0f) || (0.000001f > time) || (requested_time - time > time)
+        || ((sps <= requested_time) && (sps > time)))
+        enb_reset_sample(anim_ctx, quantization_error);
+
+    anim_ctx->requested_time = time;
+    if (time < 0.000001f)
+        return;
+
+    while ((time > anim_ctx->data.current_sample_time)
+        && (anim_ctx->data.stream->duration - anim_ctx->data.current_sample_time > 0.00001f))
+        enb_sample_step_forward(anim_ctx, quantization_error);
+
+    while (time < anim_ctx->data.previous_sample_time)
+        enb_sample_step_backward(anim_ctx, quantization_error);
+}
+
+static void enb_set_sample(enb_anim_context* anim_ctx, uint32_t sample) {
+    enb_step_to_sample(anim_ctx, sample, 0xFFFFFFFF);
+}
+
+static uint32_t enb_step_to_sample(enb_anim_context* anim_ctx, uint32_t sample, uint32_t max_steps) {
+    float_t quantization_error;
+    uint32_t current_sample;
+    int32_t restart;
+
+    quantization_error = enb_get_quantization_error(anim_ctx);
+    current_sample = anim_ctx->data.current_sample;
+    restart = anim_ctx->restart ? enb_find_restart(anim_ctx, sample) : -1;
+
+    // Same policy as enb_set_time: replay from the start when that is cheaper than walking back
+    if (restart >= 0) {
+        if (!max_steps)
+            return sample - (restart + 1) * anim_ctx->restart->interval + 1;
+
+        enb_restore_restart(anim_ctx, restart);
+        max_steps--;
+    }
+    else if ((anim_ctx->requested_time == -1.0f) || ((sample < current_sample)
+        && ((sample <= 1) || (current_sample - sample > sample)))) {
+        if (!max_steps)
+            return sample + 1;
+
+        enb_reset_sample(anim_ctx, quantization_error);
+        max_steps--;
+    }
+
+    for (; max_steps && anim_ctx->data.current_sample < sample; max_steps--)
+        enb_sample_step_forward(anim_ctx, quantization_error);
+
+    for (; max_steps && anim_ctx->data.current_sample > sample; max_steps--)
+        enb_sample_step_backward(anim_ctx, quantization_error);
+
+    anim_ctx->requested_time = anim_ctx->data.current_sample_time;
+
+    current_sample = anim_ctx->data.current_sample;
+    return current_sample < sample ? sample - current_sample : current_sample - sample;
+}
+
+static float_t enb_get_quantization_error(enb_anim_context* anim_ctx) {
+    if (anim_ctx->rotation_quantization_error)
+        return 1.0f;
+    return anim_ctx->data.stream->quantization_error;
+}
+
+static void enb_reset_sample(enb_anim_context* anim_ctx, const float_t quantization_error) {
+    const int32_t track_count = anim_ctx->data.stream->track_count;
+
+    anim_ctx->data.current_sample = 0;
+    anim_ctx->data.current_sample_time = 0.0f;
+    anim_ctx->data.previous_sample_time = 0.0f;
+    anim_ctx->track_direction = 0;
+
+    enb_init_decoder(anim_ctx);
+    enb_state_step_init(&anim_ctx->state, &anim_ctx->state_data_dec);
+    enb_track_init(anim_ctx, track_count, &anim_ctx->track_data_init_dec);
+    enb_track_init_apply(anim_ctx, track_count, anim_ctx->track_flags, quantization_error);
+}
+
+inline static uint32_t enb_anim_restart_get_point_length(int32_t track_count) {
+    return sizeof(enb_anim_restart_point) + sizeof(float_t) * 14 * track_count + ((track_count + 0x03) & ~0x03);
+}
+
+static int32_t enb_find_restart(enb_anim_context* anim_ctx, uint32_t sample) {
+    const enb_anim_restart_header* header = anim_ctx->restart;
+    const uint32_t current_sample = anim_ctx->data.current_sample;
+
+    // The restart point has to lie before the sample so stepping to it decodes the previous pose too
+    if (sample <= header->interval || !header->count)
+        return -1;
+
+    int32_t restart = (int32_t)((sample - 1) / header->interval) - 1;
+    if (restart >= (int32_t)header->count)
+        restart = header->count - 1;
+
+    const uint32_t restart_sample = (restart + 1) * header->interval;
+    if (anim_ctx->requested_time == -1.0f)
+        return restart;
+    else if (sample >= current_sample)
+        return current_sample < restart_sample ? restart : -1;
+    else if (current_sample - sample > sample - restart_sample)
+        return restart;
+    return -1;
+}
+
+static void enb_restore_restart(enb_anim_context* anim_ctx, int32_t restart) {
+    const enb_anim_restart_header* header = anim_ctx->restart;
+    const int32_t track_count = anim_ctx->data.stream->track_count;
+    const float_t duration = anim_ctx->data.stream->duration;
+    const float_t sps = anim_ctx->seconds_per_sample;
+    const uint32_t sample = (restart + 1) * header->interval;
+
+    const enb_anim_restart_point* point = (const enb_anim_restart_point*)
+        &((const uint8_t*)&header[1])[restart * header->point_length];
+    const float_t* value = (const float_t*)&point[1];
+    const uint8_t* flags = (const uint8_t*)&value[14 * track_count];
+
+    enb_anim_track_data_decoder* track_data = &anim_ctx->track_data_dec;
+    enb_anim_state_data_decoder* state_data = &anim_ctx->state_data_dec;
+    if (anim_ctx->rans)
+        anim_ctx->rans->position = point->track_offset[0];
+    else {
+        track_data->i2 = &anim_ctx->track_data.i2[point->track_offset[0]];
+        track_data->i4 = &anim_ctx->track_data.i4[point->track_offset[1]];
+        track_data->i8 = (const int8_t*)&((const uint8_t*)anim_ctx->track_data.i8)[point->track_offset[2]];
+        track_data->i16 = (const int16_t*)&((const uint8_t*)anim_ctx->track_data.i16)[point->track_offset[3]];
+        track_data->i32 = (const int32_t*)&((const uint8_t*)anim_ctx->track_data.i32)[point->track_offset[4]];
+    }
+    track_data->i2_counter = point->i2_counter;
+    track_data->i4_counter = point->i4_counter;
+
+    state_data->u2 = &anim_ctx->state_data.u2[point->state_offset[0]];
+    state_data->u8 = &anim_ctx->state_data.u8[point->state_offset[1]];
+    state_data->u16 = (const uint16_t*)&((const uint8_t*)anim_ctx->state_data.u16)[point->state_offset[2]];
+    state_data->u32 = (const uint32_t*)&((const uint8_t*)anim_ctx->state_data.u32)[point->state_offset[3]];
+    state_data->u2_counter = point->u2_counter;
+
+    anim_ctx->state.next_step = point->next_step;
+    anim_ctx->state.prev_step = point->prev_step;
+
+    enb_track* track = anim_ctx->data.track;
+    for (int32_t i = 0; i < track_count; i++, track++, value += 14) {
+        track->qt[0].quat = (quat){ value[0], value[1], value[2], value[3] };
+        track->qt[0].trans = (vec3){ value[4], value[5], value[6] };
+        track->qt[0].time = sample * sps < duration ? sample * sps : duration;
+        track->qt[1] = track->qt[0];
+        track->qt[1].time = (sample - 1) * sps;
+        track->quat = (quat){ value[7], value[8], value[9], value[10] };
+        track->trans = (vec3){ value[11], value[12], value[13] };
+        track->flags = flags[i];
+    }
+
+    anim_ctx->track_selector = 0;
+    anim_ctx->track_direction = 1;
+    anim_ctx->data.current_sample = sample;
+    anim_ctx->data.current_sample_time = sample * sps;
+    anim_ctx->data.previous_sample_time = (sample - 1) * sps;
+}
+
+static void enb_sample_step_forward(enb_anim_context* anim_ctx, const float_t quantization_error) {
+    const int32_t track_count = anim_ctx->data.stream->track_count;
+    const float_t sps = anim_ctx->seconds_per_sample;
+    float_t sample_time;
+
+    if (anim_ctx->track_direction == 2) {
+        enb_anim_state_data_forward_decode(&anim_ctx->state_data_dec);
+        anim_ctx->track_direction = 1;
+    }
+    else if (anim_ctx->data.current_sample > 0) {
+        enb_state_step_forward(&anim_ctx->state,
+            anim_ctx->data.track, track_count, &anim_ctx->state_data_dec);
+        anim_ctx->track_direction = 1;
+    }
+
+    enb_track_step_forward(anim_ctx, track_count, &anim_ctx->track_data_dec);
+    sample_time = ++anim_ctx->data.current_sample * sps;
+
+    if (anim_ctx->data.stream->duration <= sample_time)
+        sample_time = anim_ctx->data.stream->duration;
+
+    enb_track_apply(anim_ctx, track_count, true, quantization_error, sample_time);
+    anim_ctx->data.current_sample_time = anim_ctx->data.current_sample * sps;
+    anim_ctx->data.previous_sample_time = (anim_ctx->data.current_sample - 1) * sps;
+}
+
+static void enb_sample_step_backward(enb_anim_context* anim_ctx, const float_t quantization_error) {
+    const int32_t track_count = anim_ctx->data.stream->track_count;
+    const float_t sps = anim_ctx->seconds_per_sample;
+
+    // The first pose comes from the init data, which no residual undoes
+    if (anim_ctx->predictor_reader && anim_ctx->data.current_sample <= 2) {
+        const uint32_t sample = anim_ctx->data.current_sample - 1;
+        enb_reset_sample(anim_ctx, quantization_error);
+        if (sample)
+            enb_sample_step_forward(anim_ctx, quantization_error);
+        return;
+    }
+
+    if (anim_ctx->track_direction == 1) {
+        enb_anim_state_data_backward_decode(&anim_ctx->state_data_dec);
+        anim_ctx->track_direction = 2;
+    }
+    else
+        enb_state_step_backward(&anim_ctx->state,
+            anim_ctx->data.track, track_count, &anim_ctx->state_data_dec);
+
+    anim_ctx->data.current_sample--;
+    enb_track_step_backward(anim_ctx, track_count, &anim_ctx->track_data_dec);
+    if (anim_ctx->predictor_reader)
+        enb_track_undo_predicted(anim_ctx, track_count);
+
+    anim_ctx->data.current_sample_time = anim_ctx->data.current_sample * sps;
+    anim_ctx->data.previous_sample_time = (anim_ctx->data.current_sample - 1) * sps;
+    enb_track_apply(anim_ctx, track_count, false, -quantization_error, anim_ctx->data.previous_sample_time);
+}
+
+static void enb_track_init(enb_anim_context* anim_ctx,
+    const int32_t track_count, enb_anim_track_data_init_decoder* track_data_init) { // 0x08A08D3C in ULJM05681
+    int32_t i, j, val;
+
+    enb_track* track = anim_ctx->data.track;
 
     for (i = 0; i < track_count; i++, track++) {
         for (j = 0; j < 7; j++) {
@@ -535,6 +3024,9 @@ static void enb_track_step_forward(enb_anim_context* anim_ctx,
     enb_track* track = anim_ctx->data.track;
 
     for (i = 0; i < track_count; i++, track++) {
+        if (anim_ctx->predictor && anim_ctx->predictor[i])
+            enb_track_reset_predicted(track, anim_ctx->predictor[i]);
+
         if (track->flags == 0)
             continue;
 
@@ -542,7 +3034,10 @@ static void enb_track_step_forward(enb_anim_context* anim_ctx,
             if ((track->flags & (1 << j)) == 0)
                 continue;
 
-            val = enb_anim_track_data_forward_decode(track_data);
+            if (anim_ctx->rans)
+                val = enb_anim_rans_decoder_forward(anim_ctx->rans);
+            else
+                val = enb_anim_track_data_forward_decode(track_data);
 
             switch (j) {
             case 0:
@@ -587,7 +3082,10 @@ static void enb_track_step_backward(enb_anim_context* anim_ctx,
             if ((track->flags & (1 << (6 - j))) == 0)
                 continue;
 
-            val = enb_anim_track_data_backward_decode(track_data);
+            if (anim_ctx->rans)
+                val = enb_anim_rans_decoder_backward(anim_ctx->rans);
+            else
+                val = enb_anim_track_data_backward_decode(track_data);
 
             switch (6 - j) {
             case 0:
@@ -671,6 +3169,7 @@ static void enb_state_step_backward(enb_anim_state* state,
 static void enb_track_init_apply(enb_anim_context* anim_ctx,
     const int32_t track_count, const uint8_t* flags, float_t quantization_error) { // 0x08A086CC in ULJM05681
     int32_t i;
+    float_t rotation_scale, translation_scale;
     quat quat_delta, quat_result;
     vec3 trans_delta, trans_result;
 
@@ -680,14 +3179,24 @@ static void enb_track_init_apply(enb_anim_context* anim_ctx,
         quat_delta = track->quat;
         trans_delta = track->trans;
 
-        quat_result.x = quat_delta.x * quantization_error;
-        quat_result.y = quat_delta.y * quantization_error;
-        quat_result.z = quat_delta.z * quantization_error;
-        quat_result.w = quat_delta.w * quantization_error;
+        rotation_scale = quantization_error;
+        translation_scale = quantization_error;
+        if (anim_ctx->rotation_quantization_error) {
+            rotation_scale *= anim_ctx->rotation_quantization_error[i];
+            translation_scale *= anim_ctx->translation_quantization_error[i];
+        }
+
+        quat_result.x = quat_delta.x * rotation_scale;
+        quat_result.y = quat_delta.y * rotation_scale;
+        quat_result.z = quat_delta.z * rotation_scale;
+        quat_result.w = quat_delta.w * rotation_scale;
 
-        trans_result.x = trans_delta.x * quantization_error;
-        trans_result.y = trans_delta.y * quantization_error;
-        trans_result.z = trans_delta.z * quantization_error;
+        trans_result.x = trans_delta.x * translation_scale;
+        trans_result.y = trans_delta.y * translation_scale;
+        trans_result.z = trans_delta.z * translation_scale;
+
+        if (anim_ctx->dropped_component && anim_ctx->dropped_component[i])
+            enb_quat_restore_component(&quat_result, anim_ctx->dropped_component[i]);
 
         normalize_quat(&quat_result, &quat_result);
 
@@ -709,6 +3218,7 @@ static void enb_track_apply(enb_anim_context* anim_ctx, const int32_t track_coun
     const bool forward, const float_t quantization_error, const float_t time) { // 0x08A085D8 in ULJM05681
     uint8_t s0, s1;
     int32_t i;
+    float_t rotation_scale, translation_scale;
     quat quat_delta, quat_result, quat_data;
     vec3 trans_delta, trans_result, trans_data;
 
@@ -726,20 +3236,35 @@ static void enb_track_apply(enb_anim_context* anim_ctx, const int32_t track_coun
     }
 
     for (i = 0; i < track_count; i++, track++) {
+        if (anim_ctx->static_track[i] || (anim_ctx->track_mask && !anim_ctx->track_mask[i]))
+            continue;
+
         quat_delta = track->quat;
         trans_delta = track->trans;
 
         quat_data = track->qt[s0].quat;
         trans_data = track->qt[s0].trans;
+        if (anim_ctx->predictor && anim_ctx->predictor[i])
+            enb_track_clear_order_0(&quat_data, &trans_data, anim_ctx->predictor[i]);
+
+        rotation_scale = quantization_error;
+        translation_scale = quantization_error;
+        if (anim_ctx->rotation_quantization_error) {
+            rotation_scale *= anim_ctx->rotation_quantization_error[i];
+            translation_scale *= anim_ctx->translation_quantization_error[i];
+        }
 
-        quat_result.x = quat_delta.x * quantization_error + quat_data.x;
-        quat_result.y = quat_delta.y * quantization_error + quat_data.y;
-        quat_result.z = quat_delta.z * quantization_error + quat_data.z;
-        quat_result.w = quat_delta.w * quantization_error + quat_data.w;
+        quat_result.x = quat_delta.x * rotation_scale + quat_data.x;
+        quat_result.y = quat_delta.y * rotation_scale + quat_data.y;
+        quat_result.z = quat_delta.z * rotation_scale + quat_data.z;
+        quat_result.w = quat_delta.w * rotation_scale + quat_data.w;
 
-        trans_result.x = trans_delta.x * quantization_error + trans_data.x;
-        trans_result.y = trans_delta.y * quantization_error + trans_data.y;
-        trans_result.z = trans_delta.z * quantization_error + trans_data.z;
+        trans_result.x = trans_delta.x * translation_scale + trans_data.x;
+        trans_result.y = trans_delta.y * translation_scale + trans_data.y;
+        trans_result.z = trans_delta.z * translation_scale + trans_data.z;
+
+        if (anim_ctx->dropped_component && anim_ctx->dropped_component[i])
+            enb_quat_restore_component(&quat_result, anim_ctx->dropped_component[i]);
 
         normalize_quat(&quat_result, &quat_result);
 
@@ -949,20 +3474,225 @@ inline static uint8_t* enb_anim_stream_get_state_data_u2(enb_anim_stream* anim_s
     return &enb_anim_stream_get_track_data_i8(anim_stream)[anim_stream->track_data_i8_length];
 }
 
-inline static uint8_t* enb_anim_stream_get_state_data_u8(enb_anim_stream* anim_stream) {
-    return &enb_anim_stream_get_state_data_u2(anim_stream)[anim_stream->state_data_u2_length];
+inline static uint8_t* enb_anim_stream_get_state_data_u8(enb_anim_stream* anim_stream) {
+    return &enb_anim_stream_get_state_data_u2(anim_stream)[anim_stream->state_data_u2_length];
+}
+
+inline static uint8_t* enb_anim_stream_get_state_data_u16(enb_anim_stream* anim_stream) {
+    return &enb_anim_stream_get_track_data_i16(anim_stream)[anim_stream->track_data_i16_length];
+}
+
+inline static uint8_t* enb_anim_stream_get_state_data_u32(enb_anim_stream* anim_stream) {
+    return &enb_anim_stream_get_track_data_i32(anim_stream)[anim_stream->track_data_i32_length];
+}
+
+inline static uint8_t* enb_anim_stream_get_track_flags(enb_anim_stream* anim_stream) {
+    return &enb_anim_stream_get_state_data_u8(anim_stream)[anim_stream->state_data_u8_length];
+}
+
+inline static float_t* enb_anim_stream_get_quantization(enb_anim_stream* anim_stream) {
+    uint8_t* data = &enb_anim_stream_get_track_flags(anim_stream)[anim_stream->track_flags_length];
+    return (float_t*)((uint8_t*)anim_stream + ((data - (uint8_t*)anim_stream + 0x03) & ~0x03));
+}
+
+inline static uint32_t enb_anim_stream_get_quantization_length(enb_anim_stream* anim_stream) {
+    if (!(anim_stream->signature & ENB_SIGNATURE_SPLIT_QUANTIZATION))
+        return 0;
+
+    uint8_t* data = &enb_anim_stream_get_track_flags(anim_stream)[anim_stream->track_flags_length];
+    return (uint32_t)((uint8_t*)enb_anim_stream_get_quantization(anim_stream) - data)
+        + sizeof(float_t) * 2 * anim_stream->track_count;
+}
+
+inline static uint8_t* enb_anim_stream_get_dropped_components(enb_anim_stream* anim_stream) {
+    return &enb_anim_stream_get_track_flags(anim_stream)[anim_stream->track_flags_length
+        + enb_anim_stream_get_quantization_length(anim_stream)];
+}
+
+inline static uint32_t enb_anim_stream_get_dropped_components_length(enb_anim_stream* anim_stream) {
+    if (!(anim_stream->signature & ENB_SIGNATURE_SMALLEST_THREE))
+        return 0;
+    return anim_stream->track_count;
+}
+
+inline static uint8_t* enb_anim_stream_get_entropy(enb_anim_stream* anim_stream) {
+    uint8_t* data = &enb_anim_stream_get_dropped_components(anim_stream)[
+        enb_anim_stream_get_dropped_components_length(anim_stream)];
+    return (uint8_t*)anim_stream + ((data - (uint8_t*)anim_stream + 0x03) & ~0x03);
+}
+
+inline static uint32_t enb_anim_stream_get_entropy_length(enb_anim_stream* anim_stream) {
+    if (!(anim_stream->signature & ENB_SIGNATURE_ENTROPY_CODED))
+        return 0;
+
+    uint8_t* data = &enb_anim_stream_get_dropped_components(anim_stream)[
+        enb_anim_stream_get_dropped_components_length(anim_stream)];
+    enb_anim_rans_header* header = (enb_anim_rans_header*)enb_anim_stream_get_entropy(anim_stream);
+    uint32_t num_blocks = (header->symbol_count + ENB_RANS_BLOCK - 1) / ENB_RANS_BLOCK;
+    return (uint32_t)((uint8_t*)header - data) + sizeof(enb_anim_rans_header)
+        + sizeof(enb_anim_rans_block) * num_blocks + header->data_length;
+}
+
+inline static uint16_t* enb_anim_stream_get_predictors(enb_anim_stream* anim_stream) {
+    uint8_t* data = &enb_anim_stream_get_dropped_components(anim_stream)[
+        enb_anim_stream_get_dropped_components_length(anim_stream)
+        + enb_anim_stream_get_entropy_length(anim_stream)];
+    return (uint16_t*)((uint8_t*)anim_stream + ((data - (uint8_t*)anim_stream + 0x03) & ~0x03));
+}
+
+inline static uint32_t enb_anim_stream_get_predictors_length(enb_anim_stream* anim_stream) {
+    if (!(anim_stream->signature & ENB_SIGNATURE_PREDICTOR))
+        return 0;
+
+    uint8_t* data = &enb_anim_stream_get_dropped_components(anim_stream)[
+        enb_anim_stream_get_dropped_components_length(anim_stream)
+        + enb_anim_stream_get_entropy_length(anim_stream)];
+    return (uint32_t)((uint8_t*)enb_anim_stream_get_predictors(anim_stream) - data)
+        + sizeof(uint16_t) * anim_stream->track_count;
+}
+
+inline static uint8_t* enb_anim_stream_get_restart(enb_anim_stream* anim_stream) {
+    uint8_t* data = &enb_anim_stream_get_dropped_components(anim_stream)[
+        enb_anim_stream_get_dropped_components_length(anim_stream)
+        + enb_anim_stream_get_entropy_length(anim_stream)
+        + enb_anim_stream_get_predictors_length(anim_stream)];
+    return (uint8_t*)anim_stream + ((data - (uint8_t*)anim_stream + 0x03) & ~0x03);
+}
+
+inline static uint32_t enb_anim_stream_get_restart_length(enb_anim_stream* anim_stream) {
+    if (!(anim_stream->signature & ENB_SIGNATURE_RESTART))
+        return 0;
+
+    uint8_t* data = &enb_anim_stream_get_dropped_components(anim_stream)[
+        enb_anim_stream_get_dropped_components_length(anim_stream)
+        + enb_anim_stream_get_entropy_length(anim_stream)
+        + enb_anim_stream_get_predictors_length(anim_stream)];
+    enb_anim_restart_header* header = (enb_anim_restart_header*)enb_anim_stream_get_restart(anim_stream);
+    return (uint32_t)((uint8_t*)header - data) + sizeof(enb_anim_restart_header)
+        + header->count * header->point_length;
+}
+
+inline static void enb_quat_restore_component(quat* q, uint8_t dropped_component) {
+    float_t* value = &q->x + (dropped_component & 0x03);
+    *value = 0.0f;
+
+    float_t w = 1.0f - (q->x * q->x + q->y * q->y + q->z * q->z + q->w * q->w);
+    w = w > 0.0f ? sqrtf(w) : 0.0f;
+    *value = dropped_component & ENB_DROPPED_COMPONENT_NEGATIVE ? -w : w;
+}
+
+inline static void enb_track_reset_predicted(enb_track* track, uint16_t predictor) {
+    for (int32_t i = 0; i < 4; i++)
+        if (ENB_PREDICTOR_GET(predictor, i) != ENB_PREDICTOR_ORDER_2)
+            (&track->quat.x)[i] = 0.0f;
+
+    for (int32_t i = 0; i < 3; i++)
+        if (ENB_PREDICTOR_GET(predictor, i + 4) != ENB_PREDICTOR_ORDER_2)
+            (&track->trans.x)[i] = 0.0f;
+}
+
+inline static void enb_track_clear_order_0(quat* quat_data, vec3* trans_data, uint16_t predictor) {
+    for (int32_t i = 0; i < 4; i++)
+        if (ENB_PREDICTOR_GET(predictor, i) == ENB_PREDICTOR_ORDER_0)
+            (&quat_data->x)[i] = 0.0f;
+
+    for (int32_t i = 0; i < 3; i++)
+        if (ENB_PREDICTOR_GET(predictor, i + 4) == ENB_PREDICTOR_ORDER_0)
+            (&trans_data->x)[i] = 0.0f;
 }
 
-inline static uint8_t* enb_anim_stream_get_state_data_u16(enb_anim_stream* anim_stream) {
-    return &enb_anim_stream_get_track_data_i16(anim_stream)[anim_stream->track_data_i16_length];
+static enb_anim_predictor_reader* enb_anim_predictor_reader_create(int32_t track_count) {
+    enb_anim_predictor_reader* reader = (enb_anim_predictor_reader*)malloc(sizeof(enb_anim_predictor_reader)
+        + sizeof(enb_track) * track_count + sizeof(int32_t) * 2 * 7 * track_count);
+    if (!reader)
+        return 0;
+
+    memset((void*)reader, 0, sizeof(enb_anim_predictor_reader));
+    reader->sample = -1;
+    reader->track = (enb_track*)&reader[1];
+    reader->residual[0] = (int32_t*)&reader->track[track_count];
+    reader->residual[1] = &reader->residual[0][7 * track_count];
+    memset((void*)reader->track, 0, sizeof(enb_track) * track_count);
+    return reader;
 }
 
-inline static uint8_t* enb_anim_stream_get_state_data_u32(enb_anim_stream* anim_stream) {
-    return &enb_anim_stream_get_track_data_i32(anim_stream)[anim_stream->track_data_i32_length];
+// Reads the residuals of the next step back the way enb_sample_step_backward does, without applying them
+static void enb_anim_predictor_reader_step(enb_anim_context* anim_ctx, int32_t* residual) {
+    enb_anim_predictor_reader* reader = anim_ctx->predictor_reader;
+    const int32_t track_count = anim_ctx->data.stream->track_count;
+    enb_track* track = reader->track;
+
+    uint32_t position = 0;
+    if (anim_ctx->rans) {
+        position = anim_ctx->rans->position;
+        anim_ctx->rans->position = reader->rans_position;
+    }
+
+    enb_state_step_backward(&reader->state, track, track_count, &reader->state_data);
+    memset(residual, 0, sizeof(int32_t) * 7 * track_count);
+    for (int32_t i = track_count - 1; i != -1; i--) {
+        if (track[i].flags == 0)
+            continue;
+
+        for (int32_t j = 6; j != -1; j--)
+            if (track[i].flags & (1 << j))
+                residual[i * 7 + j] = anim_ctx->rans ? enb_anim_rans_decoder_backward(anim_ctx->rans)
+                    : enb_anim_track_data_backward_decode(&reader->track_data);
+    }
+
+    if (anim_ctx->rans) {
+        reader->rans_position = anim_ctx->rans->position;
+        anim_ctx->rans->position = position;
+    }
 }
 
-inline static uint8_t* enb_anim_stream_get_track_flags(enb_anim_stream* anim_stream) {
-    return &enb_anim_stream_get_state_data_u8(anim_stream)[anim_stream->state_data_u8_length];
+// Order 2 accumulators step back by subtracting the residual, order 1 ones become the residual of
+// the current sample and order 0 ones the negated residual of the sample before, so that
+// enb_track_apply with the negated quantization error yields the previous pose
+static void enb_track_undo_predicted(enb_anim_context* anim_ctx, const int32_t track_count) {
+    enb_anim_predictor_reader* reader = anim_ctx->predictor_reader;
+    const int32_t sample = (int32_t)anim_ctx->data.current_sample;
+
+    // The reader state only depends on the sample, so one step behind it just reads one more step
+    if (reader->sample == sample + 1) {
+        int32_t* residual = reader->residual[0];
+        reader->residual[0] = reader->residual[1];
+        reader->residual[1] = residual;
+        enb_anim_predictor_reader_step(anim_ctx, reader->residual[1]);
+    }
+    else if (reader->sample != sample) {
+        reader->track_data = anim_ctx->track_data_dec;
+        reader->state_data = anim_ctx->state_data_dec;
+        reader->state = anim_ctx->state;
+        reader->rans_position = anim_ctx->rans ? anim_ctx->rans->position : 0;
+        for (int32_t i = 0; i < track_count; i++)
+            reader->track[i].flags = anim_ctx->data.track[i].flags;
+
+        enb_anim_predictor_reader_step(anim_ctx, reader->residual[0]);
+        enb_anim_predictor_reader_step(anim_ctx, reader->residual[1]);
+    }
+    reader->sample = sample;
+
+    enb_track* track = anim_ctx->data.track;
+    for (int32_t i = 0; i < track_count; i++, track++) {
+        const uint16_t predictor = anim_ctx->predictor[i];
+        if (!predictor)
+            continue;
+
+        const int32_t* current = &reader->residual[0][i * 7];
+        const int32_t* previous = &reader->residual[1][i * 7];
+        for (int32_t j = 0; j < 7; j++) {
+            float_t* value = j < 4 ? &(&track->quat.x)[j] : &(&track->trans.x)[j - 4];
+            switch (ENB_PREDICTOR_GET(predictor, j)) {
+            case ENB_PREDICTOR_ORDER_1:
+                *value = (float_t)current[j];
+                break;
+            case ENB_PREDICTOR_ORDER_0:
+                *value = -(float_t)previous[j];
+                break;
+            }
+        }
+    }
 }
 
 inline static uint32_t enb_anim_stream_get_length(enb_anim_stream* anim_stream) {
@@ -980,33 +3710,298 @@ inline static uint32_t enb_anim_stream_get_length(enb_anim_stream* anim_stream)
         + anim_stream->state_data_u8_length
         + anim_stream->state_data_u16_length
         + anim_stream->state_data_u32_length
-        + anim_stream->track_flags_length;
+        + anim_stream->track_flags_length
+        + enb_anim_stream_get_quantization_length(anim_stream)
+        + enb_anim_stream_get_dropped_components_length(anim_stream)
+        + enb_anim_stream_get_entropy_length(anim_stream)
+        + enb_anim_stream_get_predictors_length(anim_stream)
+        + enb_anim_stream_get_restart_length(anim_stream);
+}
+
+static bool enb_anim_rans_decoder_init(enb_anim_rans_decoder* rans, enb_anim_stream* anim_stream) {
+    const enb_anim_rans_header* header = (const enb_anim_rans_header*)enb_anim_stream_get_entropy(anim_stream);
+    uint32_t num_blocks = (header->symbol_count + ENB_RANS_BLOCK - 1) / ENB_RANS_BLOCK;
+
+    rans->blocks = (const enb_anim_rans_block*)&header[1];
+    rans->data = (const uint8_t*)&rans->blocks[num_blocks];
+    rans->i8 = (const int8_t*)enb_anim_stream_get_track_data_i8(anim_stream);
+    rans->i16 = (const int16_t*)enb_anim_stream_get_track_data_i16(anim_stream);
+    rans->i32 = (const int32_t*)enb_anim_stream_get_track_data_i32(anim_stream);
+    rans->symbol_count = header->symbol_count;
+    rans->position = 0;
+    rans->block = -1;
+
+    uint32_t start = 0;
+    for (int32_t i = 0; i < ENB_RANS_SYMBOLS; i++) {
+        rans->freq[i] = header->freq[i];
+        rans->start[i] = (uint16_t)start;
+        if (start + header->freq[i] > ENB_RANS_SCALE)
+            return false;
+
+        memset(&rans->slot[start], i, header->freq[i]);
+        start += header->freq[i];
+    }
+    return start == ENB_RANS_SCALE || !header->symbol_count;
+}
+
+static void enb_anim_rans_decoder_decode_block(enb_anim_rans_decoder* rans, int32_t block) {
+    const enb_anim_rans_block* rans_block = &rans->blocks[block];
+    const uint8_t* data = &rans->data[rans_block->offset];
+    const int8_t* i8 = &rans->i8[rans_block->i8];
+    const int16_t* i16 = &rans->i16[rans_block->i16];
+    const int32_t* i32 = &rans->i32[rans_block->i32];
+    uint32_t count = rans->symbol_count - (uint32_t)block * ENB_RANS_BLOCK;
+    if (count > ENB_RANS_BLOCK)
+        count = ENB_RANS_BLOCK;
+
+    uint32_t x = data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t)data[3] << 24);
+    data += 4;
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t slot = x & (ENB_RANS_SCALE - 1);
+        uint8_t symbol = rans->slot[slot];
+        x = rans->freq[symbol] * (x >> ENB_RANS_SCALE_BITS) + slot - rans->start[symbol];
+        while (x < ENB_RANS_LOW)
+            x = (x << 8) | *data++;
+
+        switch (symbol) {
+        case ENB_RANS_ESCAPE_I8:
+            rans->value[i] = *i8++;
+            break;
+        case ENB_RANS_ESCAPE_I16:
+            rans->value[i] = *i16++;
+            break;
+        case ENB_RANS_ESCAPE_I32:
+            rans->value[i] = *i32++;
+            break;
+        default:
+            rans->value[i] = (int32_t)symbol - ENB_RANS_VALUE_RANGE;
+            break;
+        }
+    }
+    rans->block = block;
+}
+
+inline static int32_t enb_anim_rans_decoder_forward(enb_anim_rans_decoder* rans) {
+    uint32_t position = rans->position++;
+    if ((int32_t)(position / ENB_RANS_BLOCK) != rans->block)
+        enb_anim_rans_decoder_decode_block(rans, position / ENB_RANS_BLOCK);
+    return rans->value[position % ENB_RANS_BLOCK];
+}
+
+inline static int32_t enb_anim_rans_decoder_backward(enb_anim_rans_decoder* rans) {
+    uint32_t position = --rans->position;
+    if ((int32_t)(position / ENB_RANS_BLOCK) != rans->block)
+        enb_anim_rans_decoder_decode_block(rans, position / ENB_RANS_BLOCK);
+    return rans->value[position % ENB_RANS_BLOCK];
+}
+
+static void enb_anim_rans_normalize_freq(const uint32_t* hist, uint32_t count, uint16_t* freq) {
+    int32_t total = 0;
+    int32_t largest = 0;
+    for (int32_t i = 0; i < ENB_RANS_SYMBOLS; i++) {
+        freq[i] = 0;
+        if (!hist[i])
+            continue;
+
+        uint32_t f = (uint32_t)((uint64_t)hist[i] * ENB_RANS_SCALE / count);
+        freq[i] = (uint16_t)(f ? f : 1);
+        total += freq[i];
+        if (hist[i] > hist[largest])
+            largest = i;
+    }
+
+    // Rounding slack goes to the most frequent symbol, overshoot is taken from the largest frequencies
+    if (total < ENB_RANS_SCALE)
+        freq[largest] += (uint16_t)(ENB_RANS_SCALE - total);
+
+    while (total > ENB_RANS_SCALE) {
+        int32_t max = 0;
+        for (int32_t i = 1; i < ENB_RANS_SYMBOLS; i++)
+            if (freq[i] > freq[max])
+                max = i;
+
+        freq[max]--;
+        total--;
+    }
+}
+
+static void enb_anim_rans_encode(const int32_t* values, uint32_t count, enb_byte_stream* byte_stream,
+    enb_byte_stream* i8_stream, enb_byte_stream* i16_stream, enb_byte_stream* i32_stream) {
+    uint32_t num_blocks = (count + ENB_RANS_BLOCK - 1) / ENB_RANS_BLOCK;
+    uint8_t* symbols = (uint8_t*)malloc(count ? count : 1);
+    enb_anim_rans_block* blocks = (enb_anim_rans_block*)calloc(num_blocks + 1, sizeof(enb_anim_rans_block));
+    uint8_t* data = (uint8_t*)malloc((size_t)count * 2 + (size_t)num_blocks * 4 + 1);
+    uint8_t* temp = (uint8_t*)malloc(ENB_RANS_BLOCK * 2 + 4);
+    uint32_t hist[ENB_RANS_SYMBOLS] = { 0 };
+    enb_byte_stream_init(byte_stream);
+    enb_byte_stream_init(i8_stream);
+    enb_byte_stream_init(i16_stream);
+    enb_byte_stream_init(i32_stream);
+    if (!symbols || !blocks || !data || !temp) {
+        free(symbols);
+        free(blocks);
+        free(data);
+        free(temp);
+        return;
+    }
+
+    // Small residuals are coded directly, larger ones escape into the i8/i16/i32 sections
+    for (uint32_t i = 0; i < count; i++) {
+        int32_t value = values[i];
+        if (value >= -ENB_RANS_VALUE_RANGE && value <= ENB_RANS_VALUE_RANGE)
+            symbols[i] = (uint8_t)(value + ENB_RANS_VALUE_RANGE);
+        else if (value >= -0x80 && value <= 0x7F)
+            symbols[i] = ENB_RANS_ESCAPE_I8;
+        else if (value >= -0x8000 && value <= 0x7FFF)
+            symbols[i] = ENB_RANS_ESCAPE_I16;
+        else
+            symbols[i] = ENB_RANS_ESCAPE_I32;
+        hist[symbols[i]]++;
+    }
+
+    enb_anim_rans_header header;
+    memset(&header, 0, sizeof(enb_anim_rans_header));
+    if (count)
+        enb_anim_rans_normalize_freq(hist, count, header.freq);
+
+    uint16_t start[ENB_RANS_SYMBOLS];
+    for (int32_t i = 0, j = 0; i < ENB_RANS_SYMBOLS; j += header.freq[i], i++)
+        start[i] = (uint16_t)j;
+
+    // Blocks are flushed independently so the decoder can re-enter any of them when stepping backward
+    uint32_t data_length = 0;
+    uint32_t i8_count = 0;
+    uint32_t i16_count = 0;
+    uint32_t i32_count = 0;
+    for (uint32_t i = 0; i < num_blocks; i++) {
+        uint32_t first = i * ENB_RANS_BLOCK;
+        uint32_t last = first + ENB_RANS_BLOCK < count ? first + ENB_RANS_BLOCK : count;
+        blocks[i].offset = data_length;
+        blocks[i].i8 = i8_count;
+        blocks[i].i16 = i16_count;
+        blocks[i].i32 = i32_count;
+
+        uint8_t* ptr = temp + ENB_RANS_BLOCK * 2 + 4;
+        uint32_t x = ENB_RANS_LOW;
+        for (uint32_t j = last; j > first; j--) {
+            uint8_t symbol = symbols[j - 1];
+            uint32_t freq = header.freq[symbol];
+            uint32_t x_max = ((ENB_RANS_LOW >> ENB_RANS_SCALE_BITS) << 8) * freq;
+            while (x >= x_max) {
+                *--ptr = (uint8_t)x;
+                x >>= 8;
+            }
+            x = ((x / freq) << ENB_RANS_SCALE_BITS) + (x % freq) + start[symbol];
+            i8_count += symbol == ENB_RANS_ESCAPE_I8;
+            i16_count += symbol == ENB_RANS_ESCAPE_I16;
+            i32_count += symbol == ENB_RANS_ESCAPE_I32;
+        }
+
+        ptr -= 4;
+        ptr[0] = (uint8_t)x;
+        ptr[1] = (uint8_t)(x >> 8);
+        ptr[2] = (uint8_t)(x >> 16);
+        ptr[3] = (uint8_t)(x >> 24);
+
+        uint32_t size = (uint32_t)(temp + ENB_RANS_BLOCK * 2 + 4 - ptr);
+        memcpy(&data[data_length], ptr, size);
+        data_length += size;
+    }
+
+    header.symbol_count = count;
+    header.data_length = data_length;
+
+    if (i8_count)
+        enb_byte_stream_alloc(i8_stream, sizeof(int8_t) * i8_count);
+    if (i16_count)
+        enb_byte_stream_alloc(i16_stream, sizeof(int16_t) * i16_count);
+    if (i32_count)
+        enb_byte_stream_alloc(i32_stream, sizeof(int32_t) * i32_count);
+
+    int8_t* i8 = (int8_t*)enb_byte_stream_get_data(i8_stream);
+    int16_t* i16 = (int16_t*)enb_byte_stream_get_data(i16_stream);
+    int32_t* i32 = (int32_t*)enb_byte_stream_get_data(i32_stream);
+    if ((!i8 && i8_count) || (!i16 && i16_count) || (!i32 && i32_count)) {
+        enb_byte_stream_free(i8_stream);
+        enb_byte_stream_free(i16_stream);
+        enb_byte_stream_free(i32_stream);
+        free(symbols);
+        free(blocks);
+        free(data);
+        free(temp);
+        return;
+    }
+
+    for (uint32_t i = 0; i < count; i++)
+        switch (symbols[i]) {
+        case ENB_RANS_ESCAPE_I8:
+            *i8++ = (int8_t)values[i];
+            break;
+        case ENB_RANS_ESCAPE_I16:
+            *i16++ = (int16_t)values[i];
+            break;
+        case ENB_RANS_ESCAPE_I32:
+            *i32++ = values[i];
+            break;
+        }
+
+    size_t size = sizeof(enb_anim_rans_header) + sizeof(enb_anim_rans_block) * num_blocks + data_length;
+    enb_byte_stream_alloc(byte_stream, size);
+    uint8_t* out = enb_byte_stream_get_data(byte_stream);
+    if (out) {
+        memcpy(out, &header, sizeof(enb_anim_rans_header));
+        out += sizeof(enb_anim_rans_header);
+        memcpy(out, blocks, sizeof(enb_anim_rans_block) * num_blocks);
+        out += sizeof(enb_anim_rans_block) * num_blocks;
+        memcpy(out, data, data_length);
+    }
+    else
+        enb_byte_stream_set_size(byte_stream, 0);
+
+    free(symbols);
+    free(blocks);
+    free(data);
+    free(temp);
+}
+
+inline static int32_t enb_ctz64(uint64_t value) {
+#if defined(__GNUC__)
+    return __builtin_ctzll(value);
+#else
+    int32_t count = 0;
+    while (!(value & 0x01)) {
+        value >>= 1;
+        count++;
+    }
+    return count;
+#endif
 }
 
 static void enb_anim_stream_encoder_find_value_ranges(
-    enb_anim_track_sample* samples, int32_t size, int32_t min_range_size) {
+    enb_anim_tracks* samples, int32_t size, int32_t min_range_size) {
+    uint8_t* has_value = samples->has_value;
     int32_t range_size = 0;
     for (int32_t i = 0; i < 7; i++) {
-        bool no_value = true;
+        const int32_t* value = samples->value[i];
+        const uint8_t mask = (uint8_t)~(0x01 << i);
+
+        int32_t any_value = 0;
         for (int32_t j = 1; j < size; j++)
-            if (samples[j].comp[i].value) {
-                no_value = false;
-                break;
-            }
+            any_value |= value[j];
 
-        if (no_value) {
+        if (!any_value) {
             for (int32_t j = 1; j < size; j++)
-                samples[j].comp[i].has_value = false;
+                has_value[j] &= mask;
             continue;
         }
 
         bool set_no_value = true;
         int32_t l;
         for (l = 1; l < size; l++)
-            if (samples[l].comp[i].value) {
+            if (value[l]) {
                 if (set_no_value && range_size > min_range_size / 2 || range_size > min_range_size)
                     for (int32_t k = l - 1; k > l - 1 - range_size; k--)
-                        samples[k].comp[i].has_value = false;
+                        has_value[k] &= mask;
                 range_size = 0;
                 set_no_value = false;
             }
@@ -1015,59 +4010,692 @@ static void enb_anim_stream_encoder_find_value_ranges(
 
         if (range_size > min_range_size / 2)
             for (int32_t k = l - 1; k > l - 1 - range_size; k--)
-                samples[k].comp[i].has_value = false;
+                has_value[k] &= mask;
         range_size = 0;
     }
 }
 
+static void enb_anim_tracks_get_has_value_bits(enb_anim_tracks* track_data,
+    int32_t num_tracks, int32_t sample, uint64_t* bits, int32_t num_words) {
+    memset(bits, 0, sizeof(uint64_t) * num_words);
+    for (int32_t i = 0; i < num_tracks; i++) {
+        uint64_t has_value = track_data[i].has_value[sample];
+        if (!has_value)
+            continue;
+
+        int32_t bit = i * 7;
+        bits[bit >> 6] |= has_value << (bit & 0x3F);
+        if ((bit & 0x3F) > 64 - 7)
+            bits[(bit >> 6) + 1] |= has_value >> (64 - (bit & 0x3F));
+    }
+}
+
 static void enb_anim_stream_encoder_write(enb_anim_tracks* track_data, int32_t num_tracks,
     int32_t num_components, int32_t num_track_data_samples, enb_anim_track_init_stream* track_data_init_stream,
     enb_anim_track_stream* track_data_stream, enb_anim_state_stream* state_data_stream,
-    enb_byte_stream* track_flags_byte_stream, FILE* f) {
+    enb_byte_stream* track_flags_byte_stream, enb_arena* arena, FILE* f) {
     if (num_track_data_samples > 0)
         for (int32_t j = 0; j < num_tracks; j++)
             for (int32_t k = 0; k < 7; k++)
                     enb_anim_track_init_stream_put_value(track_data_init_stream,
-                        track_data[j].samples->comp[k].value);
+                        track_data[j].value[k][0]);
+
+    for (int32_t i = 1; i < num_track_data_samples; i++)
+        for (int32_t j = 0; j < num_tracks; j++) {
+            uint8_t has_value = track_data[j].has_value[i];
+            for (int32_t k = 0; k < 7; k++)
+                if (has_value & (0x01 << k))
+                    enb_anim_track_stream_put_value(track_data_stream,
+                        track_data[j].value[k][i]);
+        }
+
+    enb_octet_stream track_flags_stream;
+    enb_octet_stream_init(&track_flags_stream, arena);
+
+    uint8_t* track_flags = enb_octet_stream_put_span(&track_flags_stream, num_tracks);
+    if (track_flags)
+        for (int32_t i = 0; i < num_tracks; i++)
+            track_flags[i] = track_data[i].has_value[1];
+
+    enb_octet_stream_copy_to_byte_stream(&track_flags_stream, track_flags_byte_stream);
+    enb_octet_stream_free(&track_flags_stream);
+
+    const int32_t num_comps = num_tracks * 7;
+    const int32_t num_words = (num_comps + 63) / 64;
+    uint64_t* bits = (uint64_t*)calloc((size_t)num_words * 2, sizeof(uint64_t));
+    if (!bits)
+        return;
+
+    uint64_t* prev_bits = bits;
+    uint64_t* curr_bits = bits + num_words;
+
+    if (num_track_data_samples > 1)
+        enb_anim_tracks_get_has_value_bits(track_data, num_tracks, 1, prev_bits, num_words);
+
+    int64_t last_step = -1;
+    for (int32_t i = 2; i < num_track_data_samples; i++) {
+        enb_anim_tracks_get_has_value_bits(track_data, num_tracks, i, curr_bits, num_words);
+
+        const int64_t sample_step = (int64_t)(i - 2) * num_comps;
+        for (int32_t j = 0; j < num_words; j++) {
+            uint64_t diff = curr_bits[j] ^ prev_bits[j];
+            while (diff) {
+                int32_t comp = j * 64 + enb_ctz64(diff);
+                diff &= diff - 1;
+
+                int64_t curr_step = sample_step + comp;
+                enb_anim_state_stream_put_value(state_data_stream, (uint32_t)(curr_step - last_step - 1));
+                if (f)
+                    fprintf(f, "boneId: %d,  compNum: %d,  step: %d\n",
+                        comp / 7, comp % 7, (int32_t)(curr_step - last_step - 1));
+                last_step = curr_step;
+            }
+        }
+
+        uint64_t* temp = prev_bits;
+        prev_bits = curr_bits;
+        curr_bits = temp;
+    }
+
+    free(bits);
+
+    int64_t total_steps = num_track_data_samples > 2 ? (int64_t)(num_track_data_samples - 2) * num_comps : 0;
+    uint32_t step = (uint32_t)(total_steps - last_step - 1);
+    enb_anim_state_stream_put_value(state_data_stream, step + 100);
+
+    if (f)
+        fprintf(f, "step: %d\n", step + 100);
+}
+
+static void enb_anim_stream_encoder_output(enb_anim_track_init_stream* track_data_init_stream,
+    enb_anim_track_stream* track_data_stream, enb_anim_state_stream* state_data_stream,
+    enb_byte_stream* track_flags_byte_stream, int32_t num_tracks, float_t duration,
+    const enb_plain_animation* plain_anim, uint8_t** data_out, size_t* data_out_len) {
+    enb_byte_stream track_data_init_i2_byte_stream;
+    enb_byte_stream track_data_init_i8_byte_stream;
+    enb_byte_stream track_data_init_i16_byte_stream;
+    enb_byte_stream track_data_init_i32_byte_stream;
+    enb_byte_stream track_data_i2_byte_stream;
+    enb_byte_stream track_data_i4_byte_stream;
+    enb_byte_stream track_data_i8_byte_stream;
+    enb_byte_stream track_data_i16_byte_stream;
+    enb_byte_stream track_data_i32_byte_stream;
+    enb_byte_stream state_data_u2_byte_stream;
+    enb_byte_stream state_data_u8_byte_stream;
+    enb_byte_stream state_data_u16_byte_stream;
+    enb_byte_stream state_data_u32_byte_stream;
+    enb_byte_stream_init(&track_data_init_i2_byte_stream);
+    enb_byte_stream_init(&track_data_init_i8_byte_stream);
+    enb_byte_stream_init(&track_data_init_i16_byte_stream);
+    enb_byte_stream_init(&track_data_init_i32_byte_stream);
+    enb_byte_stream_init(&track_data_i2_byte_stream);
+    enb_byte_stream_init(&track_data_i4_byte_stream);
+    enb_byte_stream_init(&track_data_i8_byte_stream);
+    enb_byte_stream_init(&track_data_i16_byte_stream);
+    enb_byte_stream_init(&track_data_i32_byte_stream);
+    enb_byte_stream_init(&state_data_u2_byte_stream);
+    enb_byte_stream_init(&state_data_u8_byte_stream);
+    enb_byte_stream_init(&state_data_u16_byte_stream);
+    enb_byte_stream_init(&state_data_u32_byte_stream);
+    enb_anim_track_init_stream_copy_to_byte_stream(
+        track_data_init_stream,
+        &track_data_init_i2_byte_stream,
+        &track_data_init_i8_byte_stream,
+        &track_data_init_i16_byte_stream,
+        &track_data_init_i32_byte_stream);
+    enb_anim_track_stream_copy_to_byte_stream(
+        track_data_stream,
+        &track_data_i2_byte_stream,
+        &track_data_i4_byte_stream,
+        &track_data_i8_byte_stream,
+        &track_data_i16_byte_stream,
+        &track_data_i32_byte_stream);
+    enb_anim_state_stream_copy_to_byte_stream(
+        state_data_stream,
+        &state_data_u2_byte_stream,
+        &state_data_u8_byte_stream,
+        &state_data_u16_byte_stream,
+        &state_data_u32_byte_stream);
+
+    enb_byte_stream entropy_byte_stream;
+    enb_byte_stream_init(&entropy_byte_stream);
+    if (plain_anim->signature & ENB_SIGNATURE_ENTROPY_CODED)
+        enb_anim_track_stream_entropy_code(
+            track_data_stream,
+            &track_data_i2_byte_stream,
+            &track_data_i4_byte_stream,
+            &track_data_i8_byte_stream,
+            &track_data_i16_byte_stream,
+            &track_data_i32_byte_stream,
+            &entropy_byte_stream);
+
+    size_t data_size = sizeof(enb_anim_stream);
+    data_size += enb_byte_stream_get_size(&track_data_init_i2_byte_stream);
+    data_size += enb_byte_stream_get_size(&track_data_init_i8_byte_stream);
+    data_size += enb_byte_stream_get_size(&track_data_init_i16_byte_stream);
+    data_size += enb_byte_stream_get_size(&track_data_init_i32_byte_stream);
+    data_size += enb_byte_stream_get_size(&track_data_i2_byte_stream);
+    data_size += enb_byte_stream_get_size(&track_data_i4_byte_stream);
+    data_size += enb_byte_stream_get_size(&track_data_i8_byte_stream);
+    data_size += enb_byte_stream_get_size(&track_data_i16_byte_stream);
+    data_size += enb_byte_stream_get_size(&track_data_i32_byte_stream);
+    data_size += enb_byte_stream_get_size(&state_data_u2_byte_stream);
+    data_size += enb_byte_stream_get_size(&state_data_u8_byte_stream);
+    data_size += enb_byte_stream_get_size(&state_data_u16_byte_stream);
+    data_size += enb_byte_stream_get_size(&state_data_u32_byte_stream);
+    data_size += enb_byte_stream_get_size(track_flags_byte_stream);
+    if (plain_anim->signature & ENB_SIGNATURE_SPLIT_QUANTIZATION)
+        data_size = ((data_size + 0x03) & ~0x03) + sizeof(float_t) * 2 * num_tracks;
+    if (plain_anim->signature & ENB_SIGNATURE_SMALLEST_THREE)
+        data_size += num_tracks;
+    if (plain_anim->signature & ENB_SIGNATURE_ENTROPY_CODED)
+        data_size = ((data_size + 0x03) & ~0x03) + enb_byte_stream_get_size(&entropy_byte_stream);
+    if (plain_anim->signature & ENB_SIGNATURE_PREDICTOR)
+        data_size = ((data_size + 0x03) & ~0x03) + sizeof(uint16_t) * num_tracks;
+
+    *data_out = 0;
+    if (!(plain_anim->signature & ENB_SIGNATURE_ENTROPY_CODED) || enb_byte_stream_get_size(&entropy_byte_stream))
+        *data_out = (uint8_t*)malloc(data_size);
+    if (*data_out) {
+        *data_out_len = data_size;
+
+        enb_anim_stream* anim_stream = (enb_anim_stream*)*data_out;
+        anim_stream->signature = plain_anim->signature;
+        anim_stream->duration = duration;
+        anim_stream->sample_rate = plain_anim->sample_rate;
+        anim_stream->track_count = num_tracks;
+        anim_stream->quantization_error = plain_anim->quantization_error;
+        anim_stream->track_data_init_i2_length = (uint32_t)enb_byte_stream_get_size(&track_data_init_i2_byte_stream);
+        anim_stream->track_data_init_i8_length = (uint32_t)enb_byte_stream_get_size(&track_data_init_i8_byte_stream);
+        anim_stream->track_data_init_i16_length = (uint32_t)enb_byte_stream_get_size(&track_data_init_i16_byte_stream);
+        anim_stream->track_data_init_i32_length = (uint32_t)enb_byte_stream_get_size(&track_data_init_i32_byte_stream);
+        anim_stream->track_data_i2_length = (uint32_t)enb_byte_stream_get_size(&track_data_i2_byte_stream);
+        anim_stream->track_data_i4_length = (uint32_t)enb_byte_stream_get_size(&track_data_i4_byte_stream);
+        anim_stream->track_data_i8_length = (uint32_t)enb_byte_stream_get_size(&track_data_i8_byte_stream);
+        anim_stream->track_data_i16_length = (uint32_t)enb_byte_stream_get_size(&track_data_i16_byte_stream);
+        anim_stream->track_data_i32_length = (uint32_t)enb_byte_stream_get_size(&track_data_i32_byte_stream);
+        anim_stream->state_data_u2_length = (uint32_t)enb_byte_stream_get_size(&state_data_u2_byte_stream);
+        anim_stream->state_data_u8_length = (uint32_t)enb_byte_stream_get_size(&state_data_u8_byte_stream);
+        anim_stream->state_data_u16_length = (uint32_t)enb_byte_stream_get_size(&state_data_u16_byte_stream);
+        anim_stream->state_data_u32_length = (uint32_t)enb_byte_stream_get_size(&state_data_u32_byte_stream);
+        anim_stream->track_flags_length = (uint32_t)enb_byte_stream_get_size(track_flags_byte_stream);
+        anim_stream->data = (uint32_t)((size_t)*data_out + sizeof(enb_anim_stream));
+
+        if (enb_byte_stream_get_size(&track_data_init_i2_byte_stream))
+            memcpy(enb_anim_stream_get_track_data_init_i2(anim_stream),
+                enb_byte_stream_get_data(&track_data_init_i2_byte_stream),
+                enb_byte_stream_get_size(&track_data_init_i2_byte_stream));
+
+        if (enb_byte_stream_get_size(&track_data_init_i8_byte_stream))
+            memcpy(enb_anim_stream_get_track_data_init_i8(anim_stream),
+                enb_byte_stream_get_data(&track_data_init_i8_byte_stream),
+                enb_byte_stream_get_size(&track_data_init_i8_byte_stream));
+
+        if (enb_byte_stream_get_size(&track_data_init_i16_byte_stream))
+            memcpy(enb_anim_stream_get_track_data_init_i16(anim_stream),
+                enb_byte_stream_get_data(&track_data_init_i16_byte_stream),
+                enb_byte_stream_get_size(&track_data_init_i16_byte_stream));
+
+        if (enb_byte_stream_get_size(&track_data_init_i32_byte_stream))
+            memcpy(enb_anim_stream_get_track_data_init_i32(anim_stream),
+                enb_byte_stream_get_data(&track_data_init_i32_byte_stream),
+                enb_byte_stream_get_size(&track_data_init_i32_byte_stream));
+
+        if (enb_byte_stream_get_size(&track_data_i2_byte_stream))
+            memcpy(enb_anim_stream_get_track_data_i2(anim_stream),
+                enb_byte_stream_get_data(&track_data_i2_byte_stream),
+                enb_byte_stream_get_size(&track_data_i2_byte_stream));
+
+        if (enb_byte_stream_get_size(&track_data_i4_byte_stream))
+            memcpy(enb_anim_stream_get_track_data_i4(anim_stream),
+                enb_byte_stream_get_data(&track_data_i4_byte_stream),
+                enb_byte_stream_get_size(&track_data_i4_byte_stream));
+
+        if (enb_byte_stream_get_size(&track_data_i8_byte_stream))
+            memcpy(enb_anim_stream_get_track_data_i8(anim_stream),
+                enb_byte_stream_get_data(&track_data_i8_byte_stream),
+                enb_byte_stream_get_size(&track_data_i8_byte_stream));
+
+        if (enb_byte_stream_get_size(&track_data_i16_byte_stream))
+            memcpy(enb_anim_stream_get_track_data_i16(anim_stream),
+                enb_byte_stream_get_data(&track_data_i16_byte_stream),
+                enb_byte_stream_get_size(&track_data_i16_byte_stream));
+
+        if (enb_byte_stream_get_size(&track_data_i32_byte_stream))
+            memcpy(enb_anim_stream_get_track_data_i32(anim_stream),
+                enb_byte_stream_get_data(&track_data_i32_byte_stream),
+                enb_byte_stream_get_size(&track_data_i32_byte_stream));
+
+        if (enb_byte_stream_get_size(&state_data_u2_byte_stream))
+            memcpy(enb_anim_stream_get_state_data_u2(anim_stream),
+                enb_byte_stream_get_data(&state_data_u2_byte_stream),
+                enb_byte_stream_get_size(&state_data_u2_byte_stream));
+
+        if (enb_byte_stream_get_size(&state_data_u8_byte_stream))
+            memcpy(enb_anim_stream_get_state_data_u8(anim_stream),
+                enb_byte_stream_get_data(&state_data_u8_byte_stream),
+                enb_byte_stream_get_size(&state_data_u8_byte_stream));
+
+        if (enb_byte_stream_get_size(&state_data_u16_byte_stream))
+            memcpy(enb_anim_stream_get_state_data_u16(anim_stream),
+                enb_byte_stream_get_data(&state_data_u16_byte_stream),
+                enb_byte_stream_get_size(&state_data_u16_byte_stream));
+
+        if (enb_byte_stream_get_size(&state_data_u32_byte_stream))
+            memcpy(enb_anim_stream_get_state_data_u32(anim_stream),
+                enb_byte_stream_get_data(&state_data_u32_byte_stream),
+                enb_byte_stream_get_size(&state_data_u32_byte_stream));
+
+        if (enb_byte_stream_get_size(track_flags_byte_stream))
+            memcpy(enb_anim_stream_get_track_flags(anim_stream),
+                enb_byte_stream_get_data(track_flags_byte_stream),
+                enb_byte_stream_get_size(track_flags_byte_stream));
+
+        if (plain_anim->signature & ENB_SIGNATURE_SPLIT_QUANTIZATION) {
+            uint8_t* data = &enb_anim_stream_get_track_flags(anim_stream)[anim_stream->track_flags_length];
+            float_t* quantization = enb_anim_stream_get_quantization(anim_stream);
+            memset(data, 0, (uint8_t*)quantization - data);
+            memcpy(quantization, plain_anim->rotation_quantization_error, sizeof(float_t) * num_tracks);
+            memcpy(&quantization[num_tracks],
+                plain_anim->translation_quantization_error, sizeof(float_t) * num_tracks);
+        }
+
+        if (plain_anim->signature & ENB_SIGNATURE_SMALLEST_THREE)
+            memcpy(enb_anim_stream_get_dropped_components(anim_stream),
+                plain_anim->dropped_component, num_tracks);
+
+        if (plain_anim->signature & ENB_SIGNATURE_ENTROPY_CODED) {
+            uint8_t* data = &enb_anim_stream_get_dropped_components(anim_stream)[
+                enb_anim_stream_get_dropped_components_length(anim_stream)];
+            uint8_t* entropy = enb_anim_stream_get_entropy(anim_stream);
+            memset(data, 0, entropy - data);
+            memcpy(entropy, enb_byte_stream_get_data(&entropy_byte_stream),
+                enb_byte_stream_get_size(&entropy_byte_stream));
+        }
+
+        if (plain_anim->signature & ENB_SIGNATURE_PREDICTOR) {
+            uint8_t* data = &enb_anim_stream_get_dropped_components(anim_stream)[
+                enb_anim_stream_get_dropped_components_length(anim_stream)
+                + enb_anim_stream_get_entropy_length(anim_stream)];
+            uint16_t* predictor = enb_anim_stream_get_predictors(anim_stream);
+            memset(data, 0, (uint8_t*)predictor - data);
+            memcpy(predictor, plain_anim->predictor, sizeof(uint16_t) * num_tracks);
+        }
+    }
+
+    enb_byte_stream_free(&entropy_byte_stream);
+    enb_byte_stream_free(&state_data_u32_byte_stream);
+    enb_byte_stream_free(&state_data_u16_byte_stream);
+    enb_byte_stream_free(&state_data_u8_byte_stream);
+    enb_byte_stream_free(&state_data_u2_byte_stream);
+    enb_byte_stream_free(&track_data_i32_byte_stream);
+    enb_byte_stream_free(&track_data_i16_byte_stream);
+    enb_byte_stream_free(&track_data_i8_byte_stream);
+    enb_byte_stream_free(&track_data_i4_byte_stream);
+    enb_byte_stream_free(&track_data_i2_byte_stream);
+    enb_byte_stream_free(&track_data_init_i32_byte_stream);
+    enb_byte_stream_free(&track_data_init_i16_byte_stream);
+    enb_byte_stream_free(&track_data_init_i8_byte_stream);
+    enb_byte_stream_free(&track_data_init_i2_byte_stream);
+
+    if (*data_out && plain_anim->restart_interval
+        && !enb_anim_stream_add_restart_points(plain_anim->restart_interval, data_out, data_out_len)) {
+        free(*data_out);
+        *data_out = 0;
+        *data_out_len = 0;
+    }
+}
+
+static bool enb_anim_stream_add_restart_points(uint32_t interval, uint8_t** data_out, size_t* data_out_len) {
+    enb_anim_stream* anim_stream = (enb_anim_stream*)*data_out;
+    const int32_t track_count = anim_stream->track_count;
+
+    enb_anim_context* anim_ctx;
+    if (enb_initialize(*data_out, &anim_ctx))
+        return false;
+
+    const uint32_t count = (anim_ctx->sample_count - 1) / interval;
+    const uint32_t point_length = enb_anim_restart_get_point_length(track_count);
+    const size_t restart_offset = (size_t)(enb_anim_stream_get_restart(anim_stream) - *data_out);
+    const size_t length = restart_offset + sizeof(enb_anim_restart_header) + (size_t)count * point_length;
+
+    uint8_t* data = (uint8_t*)malloc(length);
+    if (!data) {
+        enb_free(&anim_ctx);
+        return false;
+    }
+
+    memset(data, 0, length);
+    memcpy(data, *data_out, *data_out_len);
+
+    enb_anim_restart_header* header = (enb_anim_restart_header*)&data[restart_offset];
+    header->interval = interval;
+    header->count = count;
+    header->point_length = point_length;
+
+    // Each point is the full decoder state after stepping forward to its sample
+    for (uint32_t i = 0; i < count; i++) {
+        enb_set_sample(anim_ctx, (i + 1) * interval);
+
+        enb_anim_restart_point* point = (enb_anim_restart_point*)
+            &((uint8_t*)&header[1])[(size_t)i * point_length];
+        float_t* value = (float_t*)&point[1];
+        uint8_t* flags = (uint8_t*)&value[14 * track_count];
+
+        const enb_anim_track_data_decoder* track_data = &anim_ctx->track_data_dec;
+        const enb_anim_state_data_decoder* state_data = &anim_ctx->state_data_dec;
+        if (anim_ctx->rans)
+            point->track_offset[0] = anim_ctx->rans->position;
+        else {
+            point->track_offset[0] = (uint32_t)(track_data->i2 - anim_ctx->track_data.i2);
+            point->track_offset[1] = (uint32_t)(track_data->i4 - anim_ctx->track_data.i4);
+            point->track_offset[2] = (uint32_t)((const uint8_t*)track_data->i8
+                - (const uint8_t*)anim_ctx->track_data.i8);
+            point->track_offset[3] = (uint32_t)((const uint8_t*)track_data->i16
+                - (const uint8_t*)anim_ctx->track_data.i16);
+            point->track_offset[4] = (uint32_t)((const uint8_t*)track_data->i32
+                - (const uint8_t*)anim_ctx->track_data.i32);
+        }
+        point->state_offset[0] = (uint32_t)(state_data->u2 - anim_ctx->state_data.u2);
+        point->state_offset[1] = (uint32_t)(state_data->u8 - anim_ctx->state_data.u8);
+        point->state_offset[2] = (uint32_t)((const uint8_t*)state_data->u16
+            - (const uint8_t*)anim_ctx->state_data.u16);
+        point->state_offset[3] = (uint32_t)((const uint8_t*)state_data->u32
+            - (const uint8_t*)anim_ctx->state_data.u32);
+        point->next_step = anim_ctx->state.next_step;
+        point->prev_step = anim_ctx->state.prev_step;
+        point->i2_counter = track_data->i2_counter;
+        point->i4_counter = track_data->i4_counter;
+        point->u2_counter = state_data->u2_counter;
+
+        const enb_track* track = anim_ctx->data.track;
+        for (int32_t j = 0; j < track_count; j++, track++, value += 14) {
+            const quat_trans* qt = &track->qt[anim_ctx->track_selector & 0x01];
+            value[0] = qt->quat.x;
+            value[1] = qt->quat.y;
+            value[2] = qt->quat.z;
+            value[3] = qt->quat.w;
+            value[4] = qt->trans.x;
+            value[5] = qt->trans.y;
+            value[6] = qt->trans.z;
+            value[7] = track->quat.x;
+            value[8] = track->quat.y;
+            value[9] = track->quat.z;
+            value[10] = track->quat.w;
+            value[11] = track->trans.x;
+            value[12] = track->trans.y;
+            value[13] = track->trans.z;
+            flags[j] = track->flags;
+        }
+    }
+    enb_free(&anim_ctx);
+
+    anim_stream = (enb_anim_stream*)data;
+    anim_stream->signature |= ENB_SIGNATURE_RESTART;
+    anim_stream->data = (uint32_t)((size_t)data + sizeof(enb_anim_stream));
+
+    free(*data_out);
+    *data_out = data;
+    *data_out_len = length;
+    return true;
+}
+
+static void enb_encode_context_resample(enb_encode_context* enc_ctx,
+    const quat_trans* prev, const quat_trans* next, float_t time, quat_trans_int* dst) {
+    const int32_t num_tracks = enc_ctx->plain_anim.track_count;
+
+    const quat_trans* prev_batch[ENB_RESAMPLE_BATCH];
+    const quat_trans* next_batch[ENB_RESAMPLE_BATCH];
+    float_t blend[ENB_RESAMPLE_BATCH];
+    quat_trans curr[ENB_RESAMPLE_BATCH];
+    for (int32_t i = 0; i < num_tracks; i += ENB_RESAMPLE_BATCH) {
+        int32_t count = num_tracks - i < ENB_RESAMPLE_BATCH ? num_tracks - i : ENB_RESAMPLE_BATCH;
+        for (int32_t j = 0; j < count; j++) {
+            prev_batch[j] = &prev[i + j];
+            next_batch[j] = &next[i + j];
+            blend[j] = (time - prev[i + j].time) / (next[i + j].time - prev[i + j].time);
+        }
+
+        enb_anim_track_data_interp_batch(prev_batch, next_batch, blend, curr, count,
+            enc_ctx->quat_method, enc_ctx->trans_method);
+        for (int32_t j = 0; j < count; j++)
+            curr[j].time = time;
+
+        enb_plain_anim_get_data_batch(&enc_ctx->plain_anim, &dst[i], curr, count, i, 1);
+    }
+}
+
+static void enb_encode_context_put_sample(enb_encode_context* enc_ctx, const quat_trans_int* data) {
+    const int32_t num_tracks = enc_ctx->plain_anim.track_count;
+    const int32_t num_comps = num_tracks * 7;
+    const int32_t sample = enc_ctx->num_samples++;
+    const int32_t min_range_size = enc_ctx->min_range_size;
+
+    if (!sample) {
+        for (int32_t i = 0; i < num_tracks; i++)
+            for (int32_t j = 0; j < 7; j++) {
+                int32_t value = (&data[i].quat.x)[j];
+                enb_anim_track_init_stream_put_value(&enc_ctx->track_data_init_stream, value);
+                enc_ctx->prev_data[i * 7 + j] = value;
+                enc_ctx->prev_delta[i * 7 + j] = 0;
+            }
+        enc_ctx->num_written_samples = 1;
+        return;
+    }
+
+    int32_t* values = &enc_ctx->values[(sample % ENB_ENCODE_WINDOW) * num_comps];
+    bool* has_value = &enc_ctx->has_value[(sample % ENB_ENCODE_WINDOW) * num_comps];
+    for (int32_t i = 0; i < num_tracks; i++)
+        for (int32_t j = 0; j < 7; j++) {
+            const int32_t k = i * 7 + j;
+            int32_t delta = (&data[i].quat.x)[j] - enc_ctx->prev_data[k];
+            int32_t value = delta - enc_ctx->prev_delta[k];
+            enc_ctx->prev_data[k] = (&data[i].quat.x)[j];
+            enc_ctx->prev_delta[k] = delta;
+            values[k] = value;
+            has_value[k] = true;
+
+            int32_t range_size = enc_ctx->range_size[k];
+            if (value) {
+                enc_ctx->range_size[k] = 0;
+                enc_ctx->set_no_value[k] = false;
+                continue;
+            }
+
+            int32_t max_range_size = enc_ctx->set_no_value[k] ? min_range_size / 2 : min_range_size;
+            enc_ctx->range_size[k] = ++range_size;
+            if (range_size == max_range_size + 1)
+                enb_encode_context_drop_range(enc_ctx, k, sample - range_size + 1, range_size);
+            else if (range_size > max_range_size + 1)
+                has_value[k] = false;
+        }
+
+    while (enc_ctx->num_written_samples + min_range_size < enc_ctx->num_samples)
+        enb_encode_context_write_sample(enc_ctx, enc_ctx->num_written_samples++);
+}
+
+static void enb_encode_context_drop_range(enb_encode_context* enc_ctx, int32_t comp, int32_t sample, int32_t size) {
+    const int32_t num_comps = enc_ctx->plain_anim.track_count * 7;
+
+    for (int32_t i = sample; i < sample + size; i++)
+        enc_ctx->has_value[(i % ENB_ENCODE_WINDOW) * num_comps + comp] = false;
+}
+
+static void enb_encode_context_write_sample(enb_encode_context* enc_ctx, int32_t sample) {
+    const int32_t num_tracks = enc_ctx->plain_anim.track_count;
+    const int32_t num_comps = num_tracks * 7;
+
+    int32_t* values = &enc_ctx->values[(sample % ENB_ENCODE_WINDOW) * num_comps];
+    bool* has_value = &enc_ctx->has_value[(sample % ENB_ENCODE_WINDOW) * num_comps];
+    for (int32_t i = 0; i < num_comps; i++)
+        if (has_value[i])
+            enb_anim_track_stream_put_value(&enc_ctx->track_data_stream, values[i]);
+
+    if (sample == 1)
+        for (int32_t i = 0; i < num_tracks; i++) {
+            uint8_t flags = 0x00;
+            for (int32_t j = 0; j < 7; j++)
+                if (has_value[i * 7 + j])
+                    flags |= (uint8_t)(0x01 << j);
+            enc_ctx->track_flags[i] = flags;
+        }
+    else
+        for (int32_t i = 0; i < num_comps; i++) {
+            enc_ctx->step++;
+            if (has_value[i] != enc_ctx->prev_has_value[i]) {
+                enb_anim_state_stream_put_value(&enc_ctx->state_data_stream, enc_ctx->step - 1);
+                enc_ctx->step = 0;
+            }
+        }
+
+    memcpy(enc_ctx->prev_has_value, has_value, num_comps * sizeof(bool));
+}
+
+static void enb_verify_track(enb_verify_job* job, int32_t track_id, quat_trans* keys) {
+    int32_t count = job->track_data_count[track_id];
+    if (count < 1)
+        return;
+
+    // Reference keys get the same sign continuity as the encoder input
+    memcpy(keys, &job->track_data[job->track_data_offset[track_id]], sizeof(quat_trans) * count);
+    enb_anim_track_data_flip_rotation(keys, count);
+
+    double_t rotation_sum = 0.0;
+    double_t translation_sum = 0.0;
+    float_t rotation_max = 0.0f;
+    float_t translation_max = 0.0f;
+    const quat_trans* decoded = &job->decoded[track_id];
+    for (int32_t i = 0, j = 1; i < job->num_samples; i++, decoded += job->num_tracks) {
+        float_t time = (float_t)i * job->seconds_per_sample;
+        if (time > job->duration)
+            time = job->duration;
+
+        while (j < count - 1 && time > keys[j].time)
+            j++;
+
+        quat_trans ref;
+        if (count < 2 || time <= keys[0].time)
+            ref = keys[0];
+        else if (time >= keys[count - 1].time)
+            ref = keys[count - 1];
+        else
+            interp_quat_trans(&keys[j - 1], &keys[j], &ref,
+                (time - keys[j - 1].time) / (keys[j].time - keys[j - 1].time),
+                job->quat_method, job->trans_method);
+
+        quat q0;
+        quat q1;
+        normalize_quat(&ref.quat, &q0);
+        normalize_quat(&decoded->quat, &q1);
+        double_t dot = fabs((double_t)dot_quat(&q0, &q1));
+        float_t rotation = (float_t)(2.0 * acos(dot < 1.0 ? dot : 1.0));
+
+        double_t x = (double_t)ref.trans.x - decoded->trans.x;
+        double_t y = (double_t)ref.trans.y - decoded->trans.y;
+        double_t z = (double_t)ref.trans.z - decoded->trans.z;
+        double_t translation_squared = x * x + y * y + z * z;
+        float_t translation = (float_t)sqrt(translation_squared);
+
+        if (rotation_max < rotation)
+            rotation_max = rotation;
+        if (translation_max < translation)
+            translation_max = translation;
+        rotation_sum += (double_t)rotation * rotation;
+        translation_sum += translation_squared;
+    }
+
+    enb_track_error* track_error = &job->track_error[track_id];
+    track_error->rotation_max_error = rotation_max;
+    track_error->rotation_rms_error = (float_t)sqrt(rotation_sum / job->num_samples);
+    track_error->translation_max_error = translation_max;
+    track_error->translation_rms_error = (float_t)sqrt(translation_sum / job->num_samples);
+}
+
+#ifdef _WIN32
+static DWORD WINAPI enb_verify_thread(LPVOID arg) {
+#else
+static void* enb_verify_thread(void* arg) {
+#endif
+    enb_verify_job* job = (enb_verify_job*)arg;
+
+    int32_t max_count = 0;
+    for (int32_t i = job->first_track; i < job->num_tracks; i += job->track_step)
+        if (max_count < job->track_data_count[i])
+            max_count = job->track_data_count[i];
+
+    quat_trans* keys = (quat_trans*)malloc(sizeof(quat_trans) * (max_count > 0 ? max_count : 1));
+    if (keys)
+        for (int32_t i = job->first_track; i < job->num_tracks; i += job->track_step)
+            enb_verify_track(job, i, keys);
+    free(keys);
+    return 0;
+}
+
+#ifdef _WIN32
+static DWORD WINAPI enb_decode_thread(LPVOID arg) {
+#else
+static void* enb_decode_thread(void* arg) {
+#endif
+    enb_decode_job* job = (enb_decode_job*)arg;
 
-    for (int32_t i = 1; i < num_track_data_samples; i++)
-        for (int32_t j = 0; j < num_tracks; j++)
-            for (int32_t k = 0; k < 7; k++)
-                if (track_data[j].samples[i].comp[k].has_value)
-                    enb_anim_track_stream_put_value(track_data_stream,
-                        track_data[j].samples[i].comp[k].value);
+    enb_anim_context* anim_ctx;
+    if (enb_clone(job->source, &anim_ctx)) {
+        job->result = -3;
+        return 0;
+    }
 
-    enb_octet_stream track_flags_stream;
-    enb_octet_stream_init(&track_flags_stream);
+    const int32_t track_count = anim_ctx->data.stream->track_count;
+    const float_t quantization_error = enb_get_quantization_error(anim_ctx);
+    if (job->first_sample)
+        enb_restore_restart(anim_ctx, (int32_t)(job->first_sample / anim_ctx->restart->interval) - 1);
+    else
+        enb_reset_sample(anim_ctx, quantization_error);
 
-    for (int32_t i = 0; i < num_tracks; i++) {
-        uint8_t flags = 0x00;
-        for (int32_t j = 0; j < 7; j++)
-            if (track_data[i].samples[1].comp[j].has_value)
-                flags |= (uint8_t)(0x01 << j);
-        enb_octet_stream_put_u8(&track_flags_stream, flags);
+    for (uint32_t i = job->first_sample; i < job->last_sample; i++) {
+        if (i > job->first_sample)
+            enb_sample_step_forward(anim_ctx, quantization_error);
+        enb_get_sample_pose(anim_ctx, true, &job->data_out[(size_t)i * track_count]);
     }
 
-    enb_octet_stream_copy_to_byte_stream(&track_flags_stream, track_flags_byte_stream);
-    enb_octet_stream_free(&track_flags_stream);
+    enb_free(&anim_ctx);
+    return 0;
+}
 
-    uint32_t step = 0;
-    for (int32_t i = 2; i < num_track_data_samples; i++)
-        for (int32_t j = 0; j < num_tracks; j++)
-            for (int32_t k = 0; k < 7; k++) {
-                step++;
-                if (track_data[j].samples[i].comp[k].has_value != track_data[j].samples[i - 1].comp[k].has_value) {
-                    enb_anim_state_stream_put_value(state_data_stream, step - 1);
-                    if (f)
-                        fprintf(f, "boneId: %d,  compNum: %d,  step: %d\n", j, k, step - 1);
-                    step = 0;
-                }
-            }
+// Job 0 runs on the calling thread, so does any job whose thread can't be started once the others are done
+static void enb_run_jobs(enb_job_func func, void* jobs, int32_t count, size_t stride) {
+#ifdef _WIN32
+    HANDLE thread[ENB_MAX_THREADS];
+#else
+    pthread_t thread[ENB_MAX_THREADS];
+#endif
+    bool thread_started[ENB_MAX_THREADS];
+    uint8_t* job = (uint8_t*)jobs;
 
-    enb_anim_state_stream_put_value(state_data_stream, step + 100);
+    if (count > ENB_MAX_THREADS)
+        count = ENB_MAX_THREADS;
 
-    if (f)
-        fprintf(f, "step: %d\n", step + 100);
+    for (int32_t i = 1; i < count; i++) {
+#ifdef _WIN32
+        thread[i] = CreateThread(0, 0, func, &job[i * stride], 0, 0);
+        thread_started[i] = thread[i] != 0;
+#else
+        thread_started[i] = !pthread_create(&thread[i], 0, func, &job[i * stride]);
+#endif
+    }
+
+    func(job);
+    for (int32_t i = 1; i < count; i++)
+        if (thread_started[i]) {
+#ifdef _WIN32
+            WaitForSingleObject(thread[i], INFINITE);
+            CloseHandle(thread[i]);
+#else
+            pthread_join(thread[i], 0);
+#endif
+        }
+    for (int32_t i = 1; i < count; i++)
+        if (!thread_started[i])
+            func(&job[i * stride]);
 }
 
 static void enb_plain_anim_init(enb_plain_animation* plain_anim) {
@@ -1077,6 +4705,16 @@ static void enb_plain_anim_init(enb_plain_animation* plain_anim) {
     plain_anim->duration = 0.0f;
     plain_anim->quantization_error = 0.0f;
     plain_anim->sample_rate = 0;
+    plain_anim->num_rotation_flips = 0;
+    plain_anim->signature = 0;
+    plain_anim->restart_interval = 0;
+
+    for (int32_t i = 0; i < 300; i++) {
+        plain_anim->rotation_quantization_error[i] = 0.0f;
+        plain_anim->translation_quantization_error[i] = 0.0f;
+        plain_anim->dropped_component[i] = 0;
+        plain_anim->predictor[i] = 0;
+    }
 
     for (int32_t i = 0; i < 300; i++)
         plain_anim->track_data[i] = 0;
@@ -1085,10 +4723,31 @@ static void enb_plain_anim_init(enb_plain_animation* plain_anim) {
         plain_anim->num_track_data_samples[i] = 0;
 }
 
+static void enb_plain_anim_set_quantization(enb_plain_animation* plain_anim,
+    int32_t num_tracks, const enb_encode_options* options) {
+    const float_t rotation = options->rotation_quantization_error;
+    const float_t translation = options->translation_quantization_error;
+    const float_t* track_rotation = options->track_rotation_quantization_error;
+    const float_t* track_translation = options->track_translation_quantization_error;
+
+    plain_anim->quantization_error = rotation + rotation;
+    plain_anim->signature = options->signature & ENB_SIGNATURE_OPT_IN;
+    plain_anim->restart_interval = options->restart_interval;
+    if (rotation != translation || track_rotation || track_translation)
+        plain_anim->signature |= ENB_SIGNATURE_SPLIT_QUANTIZATION;
+
+    for (int32_t i = 0; i < num_tracks && i < 300; i++) {
+        float_t r = track_rotation && track_rotation[i] > 0.0f ? track_rotation[i] : rotation;
+        float_t t = track_translation && track_translation[i] > 0.0f ? track_translation[i] : translation;
+        plain_anim->rotation_quantization_error[i] = r + r;
+        plain_anim->translation_quantization_error[i] = t + t;
+    }
+}
+
 static void enb_plain_anim_prepare_data(enb_plain_animation* plain_anim, quat_trans* track_data,
     int32_t* track_data_count, int32_t num_tracks, int32_t num_components, float_t duration, int32_t sample_rate,
-    float_t quantization_error, quat_trans_interp_method quat_method, quat_trans_interp_method trans_method) {
-    plain_anim->quantization_error = quantization_error + quantization_error;
+    const enb_encode_options* options, quat_trans_interp_method quat_method, quat_trans_interp_method trans_method) {
+    enb_plain_anim_set_quantization(plain_anim, num_tracks, options);
     plain_anim->sample_rate = sample_rate;
     plain_anim->num_components = 7;
 
@@ -1119,7 +4778,7 @@ static void enb_plain_anim_prepare_data(enb_plain_animation* plain_anim, quat_tr
             block[i][k] = track_data[j];
     }
 
-    enb_plain_anim_flip_rotation(plain_anim, block);
+    plain_anim->num_rotation_flips = enb_plain_anim_flip_rotation(plain_anim, block);
     enb_plain_anim_get_animation_data(plain_anim, block, quat_method, trans_method);
 
     for (int32_t l = 0; l < num_tracks; l++)
@@ -1132,50 +4791,73 @@ static void enb_plain_anim_prepare_data(enb_plain_animation* plain_anim, quat_tr
         free(block);
 }
 
-static void enb_plain_anim_flip_rotation(enb_plain_animation* plain_anim, quat_trans** track_data) {
+static int32_t enb_plain_anim_flip_rotation(enb_plain_animation* plain_anim, quat_trans** track_data) {
+    int32_t num_flips = 0;
     for (int32_t i = 0; i < plain_anim->track_count; i++)
-        enb_anim_track_data_flip_rotation(track_data[i], plain_anim->num_track_data_samples[i]);
+        num_flips += enb_anim_track_data_flip_rotation(track_data[i], plain_anim->num_track_data_samples[i]);
+    return num_flips;
 }
 
-static void enb_anim_track_data_flip_rotation(quat_trans* track_data, int32_t count) {
-    for (int32_t i = 1; i < count; i++) {
-        if (track_data[i].quat.w * track_data[i - 1].quat.w >= 0.0f
-            || fabsf(track_data[i].quat.w - track_data[i - 1].quat.w) <= 0.1f)
-            continue;
-
+static int32_t enb_anim_track_data_flip_rotation(quat_trans* track_data, int32_t count) {
+    if (count < 2)
+        return 0;
+
+    // A key is negated when the XOR of the neighbouring dot product signs up to it is set,
+    // the signs of a batch are taken from the unmodified keys before any of them is negated
+    uint8_t flip[ENB_FLIP_BATCH];
+    int32_t num_flips = 0;
+    uint8_t sign = 0;
+    quat prev = track_data[0].quat;
+    for (int32_t i = 1; i < count; i += ENB_FLIP_BATCH) {
+        const int32_t batch_count = count - i < ENB_FLIP_BATCH ? count - i : ENB_FLIP_BATCH;
         quat_trans* data = &track_data[i];
-        double_t theta = acos(data->quat.w);
-        double_t s = sin(theta);
-        if (fabs(s) > 0.000001f) {
-            double_t axis_x = data->quat.x / s;
-            double_t axis_y = data->quat.y / s;
-            double_t axis_z = data->quat.z / s;
-            theta *= 2.0;
-            if (theta <= 0.0)
-                theta += (M_PI * 2.0);
-            else
-                theta -= (M_PI * 2.0);
-            theta /= 2.0;
-            double_t cos_val = cos(theta);
-            double_t sin_val = sin(theta);
-            data->quat.w = (float_t)cos_val;
-            data->quat.x = (float_t)(sin_val * axis_x);
-            data->quat.y = (float_t)(sin_val * axis_y);
-            data->quat.z = (float_t)(sin_val * axis_z);
+
+        for (int32_t j = 0; j < batch_count; j++) {
+            const quat* q = j ? &data[j - 1].quat : &prev;
+            flip[j] = data[j].quat.x * q->x + data[j].quat.y * q->y
+                + data[j].quat.z * q->z + data[j].quat.w * q->w < 0.0f;
+        }
+        prev = data[batch_count - 1].quat;
+
+        for (int32_t j = 0; j < batch_count; j++) {
+            sign ^= flip[j];
+            const float_t scale = sign ? -1.0f : 1.0f;
+            data[j].quat.x *= scale;
+            data[j].quat.y *= scale;
+            data[j].quat.z *= scale;
+            data[j].quat.w *= scale;
+            num_flips += sign;
         }
     }
+    return num_flips;
+}
+
+static bool enb_anim_track_data_flip_rotation_pair(const quat_trans* prev, quat_trans* data) {
+    if (dot_quat(&data->quat, &prev->quat) >= 0.0f)
+        return false;
+
+    data->quat.x = -data->quat.x;
+    data->quat.y = -data->quat.y;
+    data->quat.z = -data->quat.z;
+    data->quat.w = -data->quat.w;
+    return true;
 }
 
 static void enb_plain_anim_get_animation_data(enb_plain_animation* plain_anim,
     quat_trans** track_data, quat_trans_interp_method quat_method, quat_trans_interp_method trans_method) {
+    enb_anim_resample_table table;
+    memset(&table, 0, sizeof(enb_anim_resample_table));
+
     for (int32_t i = 0; i < plain_anim->track_count; i++)
         enb_plain_anim_get_track_data(plain_anim, track_data[i],
-            &plain_anim->num_track_data_samples[i], i, quat_method, trans_method);
+            &plain_anim->num_track_data_samples[i], i, &table, quat_method, trans_method);
+
+    enb_anim_resample_table_free(&table);
 }
 
 static void enb_plain_anim_get_track_data(enb_plain_animation* plain_anim,
     quat_trans* track_data, int32_t* num_track_data_samples, int32_t track_id,
-    quat_trans_interp_method quat_method, quat_trans_interp_method trans_method) {
+    enb_anim_resample_table* table, quat_trans_interp_method quat_method, quat_trans_interp_method trans_method) {
     int32_t _num_track_data_samples = *num_track_data_samples;
 
     float_t seconds_per_sample = 1.0f / (float_t)plain_anim->sample_rate;
@@ -1183,74 +4865,225 @@ static void enb_plain_anim_get_track_data(enb_plain_animation* plain_anim,
     int32_t max_samples = (int32_t)(plain_anim->duration / seconds_per_sample) + 2;
     plain_anim->track_data[track_id] = (quat_trans_int*)calloc(max_samples, sizeof(quat_trans_int));
 
+    // A track that can't be resampled is written without samples rather than with the input count
     quat_trans_int* data_int = plain_anim->track_data[track_id];
-    enb_plain_anim_get_data(plain_anim, &data_int[0], &track_data[0]);
+    if (!data_int || !enb_anim_resample_table_init(table, track_data,
+        _num_track_data_samples, max_samples - 2, seconds_per_sample)) {
+        *num_track_data_samples = 0;
+        return;
+    }
+
+    enb_plain_anim_get_data(plain_anim, &data_int[0], &track_data[0], track_id);
     *num_track_data_samples = 1;
 
-    for (int32_t i = 1, j = 1; i < max_samples - 1; i++) {
-        float_t time = (float_t)i * seconds_per_sample;
+    const quat_trans* prev[ENB_RESAMPLE_BATCH];
+    const quat_trans* next[ENB_RESAMPLE_BATCH];
+    quat_trans curr[ENB_RESAMPLE_BATCH];
+    for (int32_t i = 0; i < table->count; i += ENB_RESAMPLE_BATCH) {
+        int32_t count = table->count - i < ENB_RESAMPLE_BATCH ? table->count - i : ENB_RESAMPLE_BATCH;
+        for (int32_t j = 0; j < count; j++) {
+            int32_t index = table->index[i + j];
+            prev[j] = &track_data[index > 0 ? index - 1 : 0];
+            next[j] = &track_data[index];
+        }
+
+        enb_anim_track_data_interp_batch(prev, next, &table->blend[i], curr, count, quat_method, trans_method);
+        for (int32_t j = 0; j < count; j++)
+            curr[j].time = (float_t)(i + j + 1) * seconds_per_sample;
+
+        enb_plain_anim_get_data_batch(plain_anim, &data_int[*num_track_data_samples], curr, count, track_id, 0);
+        *num_track_data_samples += count;
+    }
+
+    enb_plain_anim_get_data(plain_anim, &data_int[*num_track_data_samples],
+        &track_data[_num_track_data_samples - 1], track_id);
+    data_int[(*num_track_data_samples)++].sample = (int32_t)(plain_anim->duration / seconds_per_sample) + 1;
+    plain_anim->data_count += *num_track_data_samples - _num_track_data_samples;
+}
+
+static bool enb_anim_resample_table_init(enb_anim_resample_table* table,
+    const quat_trans* track_data, int32_t num_track_data_samples, int32_t count, float_t seconds_per_sample) {
+    if (table->index && table->count == count && table->num_track_data_samples == num_track_data_samples) {
+        int32_t i;
+        for (i = 0; i < num_track_data_samples; i++)
+            if (table->track_data[i].time != track_data[i].time)
+                break;
+
+        if (i == num_track_data_samples) {
+            table->track_data = track_data;
+            return true;
+        }
+    }
+
+    if (!table->index || table->count < count) {
+        free(table->index);
+        free(table->blend);
+        table->index = (int32_t*)malloc(sizeof(int32_t) * (count > 0 ? count : 1));
+        table->blend = (float_t*)malloc(sizeof(float_t) * (count > 0 ? count : 1));
+        if (!table->index || !table->blend) {
+            enb_anim_resample_table_free(table);
+            return false;
+        }
+    }
+
+    table->track_data = track_data;
+    table->num_track_data_samples = num_track_data_samples;
+    table->count = count;
+
+    if (num_track_data_samples < 2) {
+        for (int32_t i = 0; i < count; i++) {
+            table->index[i] = 0;
+            table->blend[i] = 0.0f;
+        }
+        return true;
+    }
+
+    for (int32_t i = 0, j = 1; i < count; i++) {
+        float_t time = (float_t)(i + 1) * seconds_per_sample;
         while (time > track_data[j].time)
-            if (++j >= _num_track_data_samples) {
-                j = _num_track_data_samples - 1;
+            if (++j >= num_track_data_samples) {
+                j = num_track_data_samples - 1;
                 break;
             }
 
-        quat_trans* prev = &track_data[j - 1];
-        quat_trans* next = &track_data[j];
+        table->index[i] = j;
+        table->blend[i] = (time - track_data[j - 1].time) / (track_data[j].time - track_data[j - 1].time);
+    }
+    return true;
+}
 
-        float_t blend = (time - prev->time) / (next->time - prev->time);
+static void enb_anim_resample_table_free(enb_anim_resample_table* table) {
+    free(table->index);
+    free(table->blend);
+    table->index = 0;
+    table->blend = 0;
+    table->track_data = 0;
+    table->num_track_data_samples = 0;
+    table->count = 0;
+}
 
-        quat_trans curr;
-        switch (quat_method) {
-        case QUAT_TRANS_INTERP_NONE:
-            curr.quat = prev->quat;
-            break;
-        case QUAT_TRANS_INTERP_LERP:
-            lerp_quat(&prev->quat, &next->quat, &curr.quat, blend);
-            break;
-        case QUAT_TRANS_INTERP_SLERP:
-            slerp_quat(&prev->quat, &next->quat, &curr.quat, blend);
-        break;
+static void enb_anim_track_data_interp_batch(const quat_trans** prev, const quat_trans** next,
+    const float_t* blend, quat_trans* curr, int32_t count,
+    quat_trans_interp_method quat_method, quat_trans_interp_method trans_method) {
+    float_t x[4][ENB_RESAMPLE_BATCH];
+    float_t y[4][ENB_RESAMPLE_BATCH];
+    float_t z[4][ENB_RESAMPLE_BATCH];
+    float_t dot[ENB_RESAMPLE_BATCH];
+    int32_t i, j;
+
+    for (i = 0; i < count; i++)
+        for (j = 0; j < 4; j++) {
+            x[j][i] = (&prev[i]->quat.x)[j];
+            y[j][i] = (&next[i]->quat.x)[j];
         }
 
-        switch (trans_method) {
-        case QUAT_TRANS_INTERP_NONE:
-            curr.trans = prev->trans;
-            break;
-        case QUAT_TRANS_INTERP_LERP:
-        case QUAT_TRANS_INTERP_SLERP:
-            lerp_vec3(&prev->trans, &next->trans, &curr.trans, blend);
-            break;
+    switch (quat_method) {
+    case QUAT_TRANS_INTERP_NONE:
+        for (j = 0; j < 4; j++)
+            for (i = 0; i < count; i++)
+                z[j][i] = x[j][i];
+        break;
+    case QUAT_TRANS_INTERP_LERP:
+        for (j = 0; j < 4; j++)
+            for (i = 0; i < count; i++)
+                z[j][i] = x[j][i] * (1.0f - blend[i]) + y[j][i] * blend[i];
+        break;
+    case QUAT_TRANS_INTERP_SLERP:
+        for (i = 0; i < count; i++) {
+            float_t x_length = sqrtf(x[0][i] * x[0][i] + x[1][i] * x[1][i] + x[2][i] * x[2][i] + x[3][i] * x[3][i]);
+            float_t y_length = sqrtf(y[0][i] * y[0][i] + y[1][i] * y[1][i] + y[2][i] * y[2][i] + y[3][i] * y[3][i]);
+            x_length = x_length != 0.0f ? 1.0f / x_length : x_length;
+            y_length = y_length != 0.0f ? 1.0f / y_length : y_length;
+            for (j = 0; j < 4; j++) {
+                x[j][i] *= x_length;
+                y[j][i] *= y_length;
+            }
+
+            dot[i] = x[0][i] * y[0][i] + x[1][i] * y[1][i] + x[2][i] * y[2][i] + x[3][i] * y[3][i];
+            float_t sign = dot[i] < 0.0f ? -1.0f : 1.0f;
+            dot[i] *= sign;
+            for (j = 0; j < 4; j++) {
+                y[j][i] *= sign;
+                z[j][i] = x[j][i] * (1.0f - blend[i]) + y[j][i] * blend[i];
+            }
         }
 
-        enb_plain_anim_get_data(plain_anim, &data_int[*num_track_data_samples], &curr);
-        (*num_track_data_samples)++;
-    }
+        for (i = 0; i < count; i++) {
+            if (1.0 - dot[i] <= 0.08f)
+                continue;
 
-    enb_plain_anim_get_data(plain_anim, &data_int[*num_track_data_samples],
-        &track_data[_num_track_data_samples - 1]);
-    data_int[(*num_track_data_samples)++].sample = (int32_t)(plain_anim->duration / seconds_per_sample) + 1;
-    plain_anim->data_count += *num_track_data_samples - _num_track_data_samples;
-}
+            float_t theta = acosf(dot[i] > 1.0f ? 1.0f : dot[i]);
+            if (theta == 0.0f) {
+                for (j = 0; j < 4; j++)
+                    z[j][i] = x[j][i];
+                continue;
+            }
+
+            float_t st = 1.0f / sinf(theta);
+            float_t s0 = sinf((1.0f - blend[i]) * theta) * st;
+            float_t s1 = sinf(theta * blend[i]) * st;
+            quat quat_result;
+            quat_result.x = s0 * x[0][i] + s1 * y[0][i];
+            quat_result.y = s0 * x[1][i] + s1 * y[1][i];
+            quat_result.z = s0 * x[2][i] + s1 * y[2][i];
+            quat_result.w = s0 * x[3][i] + s1 * y[3][i];
+            normalize_quat(&quat_result, &quat_result);
+            z[0][i] = quat_result.x;
+            z[1][i] = quat_result.y;
+            z[2][i] = quat_result.z;
+            z[3][i] = quat_result.w;
+        }
+        break;
+    }
 
-static void enb_plain_anim_get_data(enb_plain_animation* plain_anim, quat_trans_int* dst, quat_trans* src) {
-    const float_t quantization_error = plain_anim->quantization_error;
+    for (i = 0; i < count; i++)
+        for (j = 0; j < 4; j++)
+            (&curr[i].quat.x)[j] = z[j][i];
 
-    dst->sample = (int32_t)((double_t)plain_anim->sample_rate * src->time + 0.5);
+    switch (trans_method) {
+    case QUAT_TRANS_INTERP_NONE:
+        for (i = 0; i < count; i++)
+            curr[i].trans = prev[i]->trans;
+        break;
+    case QUAT_TRANS_INTERP_LERP:
+    case QUAT_TRANS_INTERP_SLERP:
+        for (i = 0; i < count; i++)
+            lerp_vec3(&prev[i]->trans, &next[i]->trans, &curr[i].trans, blend[i]);
+        break;
+    }
+}
 
-    double_t quat_x = src->quat.x;
-    double_t quat_y = src->quat.y;
-    double_t quat_z = src->quat.z;
-    double_t quat_w = src->quat.w;
-    double_t length = 1.0 / sqrt(quat_x * quat_x
-        + quat_y * quat_y + quat_z * quat_z + quat_w * quat_w);
-    dst->quat.x = (int32_t)(src->quat.x * length / quantization_error);
-    dst->quat.y = (int32_t)(src->quat.y * length / quantization_error);
-    dst->quat.z = (int32_t)(src->quat.z * length / quantization_error);
-    dst->quat.w = (int32_t)(src->quat.w * length / quantization_error);
+static void enb_plain_anim_get_data(enb_plain_animation* plain_anim,
+    quat_trans_int* dst, quat_trans* src, int32_t track_id) {
+    enb_plain_anim_get_data_batch(plain_anim, dst, src, 1, track_id, 0);
+}
 
-    for (int32_t i = 4; i < plain_anim->num_components; i++)
-        (&dst->quat.x)[i] = (int32_t)((&src->quat.x)[i] / quantization_error);
+static void enb_plain_anim_get_data_batch(enb_plain_animation* plain_anim, quat_trans_int* dst,
+    const quat_trans* src, int32_t count, int32_t track_id, int32_t track_step) {
+    const float_t* rotation_quantization_error = &plain_anim->rotation_quantization_error[track_id];
+    const float_t* translation_quantization_error = &plain_anim->translation_quantization_error[track_id];
+    const float_t sample_rate = (float_t)plain_anim->sample_rate;
+
+    for (int32_t i = 0; i < count; i++) {
+        const quat_trans* s = &src[i];
+        quat_trans_int* d = &dst[i];
+        d->sample = (int32_t)((double_t)sample_rate * s->time + 0.5);
+
+        const float_t rotation = rotation_quantization_error[i * track_step];
+        const float_t translation = translation_quantization_error[i * track_step];
+
+        float_t length = sqrtf(s->quat.x * s->quat.x
+            + s->quat.y * s->quat.y + s->quat.z * s->quat.z + s->quat.w * s->quat.w);
+        float_t scale = 1.0f / (length * rotation);
+        d->quat.x = (int32_t)(s->quat.x * scale);
+        d->quat.y = (int32_t)(s->quat.y * scale);
+        d->quat.z = (int32_t)(s->quat.z * scale);
+        d->quat.w = (int32_t)(s->quat.w * scale);
+
+        d->trans.x = (int32_t)(s->trans.x / translation);
+        d->trans.y = (int32_t)(s->trans.y / translation);
+        d->trans.z = (int32_t)(s->trans.z / translation);
+    }
 }
 
 static int32_t enb_plain_anim_get_largest_track_id(enb_plain_animation* plain_anim) {
@@ -1266,22 +5099,119 @@ static int32_t enb_plain_anim_get_num_track_data_samples(enb_plain_animation* pl
 }
 
 static void enb_plain_anim_get_samples(
-    enb_plain_animation* plain_anim, int32_t track_id, enb_anim_track_sample* samples) {
+    enb_plain_animation* plain_anim, int32_t track_id, enb_anim_tracks* samples) {
+    const quat_trans_int* data = enb_plain_anim_get_track_data_sample(plain_anim, track_id, 0);
+    int32_t num_track_data_samples = enb_plain_anim_get_num_track_data_samples(plain_anim, track_id);
+    if (!data || !num_track_data_samples)
+        return;
+
+    uint16_t predictor = 0;
     for (int32_t i = 0; i < 7; i++) {
+        int32_t* value = samples->value[i];
+        int32_t order = ENB_PREDICTOR_ORDER_2;
+        if (plain_anim->signature & ENB_SIGNATURE_PREDICTOR)
+            order = enb_plain_anim_select_predictor(data, num_track_data_samples, i);
+
         int32_t prev_delta = 0;
-        int32_t* prev_data = &enb_plain_anim_get_track_data_sample(plain_anim, track_id, 0)->quat.x;
-        samples[0].comp[i].value = prev_data[i];
-        samples[0].comp[i].has_value = true;
-        int32_t num_track_data_samples = enb_plain_anim_get_num_track_data_samples(plain_anim, track_id);
-        for (int32_t j = 0; j < num_track_data_samples - 1; j++) {
-            int32_t* data = &enb_plain_anim_get_track_data_sample(plain_anim, track_id, j + 1)->quat.x;
-            int32_t delta = data[i] - prev_data[i];
-            samples[j + 1].comp[i].value = delta - prev_delta;
-            samples[j + 1].comp[i].has_value = true;
-            prev_data = data;
+        int32_t prev_data = (&data[0].quat.x)[i];
+        value[0] = prev_data;
+        for (int32_t j = 1; j < num_track_data_samples; j++) {
+            int32_t curr_data = (&data[j].quat.x)[i];
+            int32_t delta = curr_data - prev_data;
+            switch (order) {
+            case ENB_PREDICTOR_ORDER_2:
+                value[j] = delta - prev_delta;
+                break;
+            case ENB_PREDICTOR_ORDER_1:
+                value[j] = delta;
+                break;
+            case ENB_PREDICTOR_ORDER_0:
+                value[j] = curr_data;
+                break;
+            }
+            prev_data = curr_data;
             prev_delta = delta;
         }
+        predictor |= (uint16_t)(order << (i * 2));
+    }
+    plain_anim->predictor[track_id] = predictor;
+
+    memset(samples->has_value, 0x7F, num_track_data_samples);
+}
+
+static void enb_plain_anim_drop_component(
+    enb_plain_animation* plain_anim, int32_t track_id, enb_anim_tracks* samples) {
+    const quat_trans_int* data = enb_plain_anim_get_track_data_sample(plain_anim, track_id, 0);
+    int32_t num_track_data_samples = enb_plain_anim_get_num_track_data_samples(plain_anim, track_id);
+    plain_anim->dropped_component[track_id] = 0;
+    if (num_track_data_samples < 1)
+        return;
+
+    // The dropped component must keep its sign and stay large enough to rebuild precisely
+    const int32_t min_value = (int32_t)(ENB_DROPPED_COMPONENT_MIN
+        / plain_anim->rotation_quantization_error[track_id]);
+    int32_t best_comp = -1;
+    int32_t best_value = min_value;
+    for (int32_t i = 0; i < 4; i++) {
+        const bool negative = (&data[0].quat.x)[i] < 0;
+        int32_t value = 0x7FFFFFFF;
+        for (int32_t j = 0; j < num_track_data_samples && value >= best_value; j++) {
+            int32_t curr = (&data[j].quat.x)[i];
+            if ((curr < 0) != negative)
+                value = 0;
+            else if (value > (curr < 0 ? -curr : curr))
+                value = curr < 0 ? -curr : curr;
+        }
+
+        if (value >= best_value) {
+            best_comp = i;
+            best_value = value;
+        }
+    }
+
+    if (best_comp < 0)
+        return;
+
+    memset(samples->value[best_comp], 0, sizeof(int32_t) * num_track_data_samples);
+    plain_anim->dropped_component[track_id] = (uint8_t)(ENB_DROPPED_COMPONENT_SET | best_comp
+        | ((&data[0].quat.x)[best_comp] < 0 ? ENB_DROPPED_COMPONENT_NEGATIVE : 0));
+}
+
+static int32_t enb_plain_anim_select_predictor(const quat_trans_int* data, int32_t count, int32_t comp) {
+    uint32_t cost[3] = { 0, 0, 0 };
+    int32_t prev_delta = 0;
+    int32_t prev_data = (&data[0].quat.x)[comp];
+    for (int32_t j = 1; j < count; j++) {
+        int32_t curr_data = (&data[j].quat.x)[comp];
+        int32_t delta = curr_data - prev_data;
+        cost[ENB_PREDICTOR_ORDER_2] += enb_anim_residual_cost(delta - prev_delta);
+        cost[ENB_PREDICTOR_ORDER_1] += enb_anim_residual_cost(delta);
+        cost[ENB_PREDICTOR_ORDER_0] += enb_anim_residual_cost(curr_data);
+        prev_data = curr_data;
+        prev_delta = delta;
     }
+
+    // Ties keep the second order predictor, which steps backward without the trailing reader
+    int32_t order = ENB_PREDICTOR_ORDER_2;
+    if (cost[ENB_PREDICTOR_ORDER_1] < cost[order])
+        order = ENB_PREDICTOR_ORDER_1;
+    if (cost[ENB_PREDICTOR_ORDER_0] < cost[order])
+        order = ENB_PREDICTOR_ORDER_0;
+    return order;
+}
+
+inline static uint32_t enb_anim_residual_cost(int32_t value) {
+    if (!value)
+        return 1;
+    else if (value >= -0x01 && value <= 0x01)
+        return 2;
+    else if (value >= -0x09 && value <= 0x08)
+        return 6;
+    else if (value >= -0x80 - 0x08 && value <= 0x7F + 0x08)
+        return 14;
+    else if (value >= -0x8000 && value <= 0x7FFF)
+        return 30;
+    return 62;
 }
 
 static quat_trans_int* enb_plain_anim_get_track_data_sample(
@@ -1290,20 +5220,31 @@ static quat_trans_int* enb_plain_anim_get_track_data_sample(
 }
 
 static void enb_plain_anim_write_data(enb_plain_animation* plain_anim, int32_t num_tracks,
-    int32_t num_components, float_t duration, int32_t sample_rate, float_t quantization_error,
-    uint8_t** data_out, size_t* data_out_len) {
+    int32_t num_components, float_t duration, uint8_t** data_out, size_t* data_out_len) {
     int32_t num_track_data_samples = enb_plain_anim_get_num_track_data_samples(plain_anim,
         enb_plain_anim_get_largest_track_id(plain_anim));
     enb_anim_tracks* tracks = (enb_anim_tracks*)calloc(num_tracks, sizeof(enb_anim_tracks));
     if (!tracks)
         return;
 
-    for (int32_t i = 0; i < num_tracks; i++)
-        tracks[i].samples = (enb_anim_track_sample*)calloc(num_track_data_samples, sizeof(enb_anim_track_sample));
+    for (int32_t i = 0; i < num_tracks; i++) {
+        int32_t* value = (int32_t*)calloc(num_track_data_samples, sizeof(int32_t) * 7 + sizeof(uint8_t));
+        if (!value)
+            continue;
+
+        for (int32_t j = 0; j < 7; j++)
+            tracks[i].value[j] = &value[(size_t)num_track_data_samples * j];
+        tracks[i].has_value = (uint8_t*)&value[(size_t)num_track_data_samples * 7];
+    }
 
     for (int32_t i = 0; i < num_tracks; i++) {
-        enb_plain_anim_get_samples(plain_anim, i, tracks[i].samples);
-        enb_anim_stream_encoder_find_value_ranges(tracks[i].samples,
+        if (!tracks[i].value[0])
+            continue;
+
+        enb_plain_anim_get_samples(plain_anim, i, &tracks[i]);
+        if (plain_anim->signature & ENB_SIGNATURE_SMALLEST_THREE)
+            enb_plain_anim_drop_component(plain_anim, i, &tracks[i]);
+        enb_anim_stream_encoder_find_value_ranges(&tracks[i],
             enb_plain_anim_get_num_track_data_samples(plain_anim, i), 9);
     }
 
@@ -1311,179 +5252,24 @@ static void enb_plain_anim_write_data(enb_plain_animation* plain_anim, int32_t n
     enb_anim_track_init_stream track_data_init_stream;
     enb_anim_state_stream state_data_stream;
     enb_byte_stream track_flags_byte_stream;
-    enb_anim_track_stream_init(&track_data_stream);
-    enb_anim_track_init_stream_init(&track_data_init_stream);
-    enb_anim_state_stream_init(&state_data_stream);
+    enb_arena arena;
+    enb_arena_init(&arena);
+    enb_anim_track_stream_init(&track_data_stream, &arena);
+    enb_anim_track_init_stream_init(&track_data_init_stream, &arena);
+    enb_anim_state_stream_init(&state_data_stream, &arena);
     enb_byte_stream_init(&track_flags_byte_stream);
 
     FILE* f = 0;
     enb_anim_stream_encoder_write(tracks, num_tracks, 7, num_track_data_samples,
-        &track_data_init_stream, &track_data_stream, &state_data_stream, &track_flags_byte_stream, f);
-
-    enb_byte_stream track_data_init_i2_byte_stream;
-    enb_byte_stream track_data_init_i8_byte_stream;
-    enb_byte_stream track_data_init_i16_byte_stream;
-    enb_byte_stream track_data_init_i32_byte_stream;
-    enb_byte_stream track_data_i2_byte_stream;
-    enb_byte_stream track_data_i4_byte_stream;
-    enb_byte_stream track_data_i8_byte_stream;
-    enb_byte_stream track_data_i16_byte_stream;
-    enb_byte_stream track_data_i32_byte_stream;
-    enb_byte_stream state_data_u2_byte_stream;
-    enb_byte_stream state_data_u8_byte_stream;
-    enb_byte_stream state_data_u16_byte_stream;
-    enb_byte_stream state_data_u32_byte_stream;
-    enb_byte_stream_init(&track_data_init_i2_byte_stream);
-    enb_byte_stream_init(&track_data_init_i8_byte_stream);
-    enb_byte_stream_init(&track_data_init_i16_byte_stream);
-    enb_byte_stream_init(&track_data_init_i32_byte_stream);
-    enb_byte_stream_init(&track_data_i2_byte_stream);
-    enb_byte_stream_init(&track_data_i4_byte_stream);
-    enb_byte_stream_init(&track_data_i8_byte_stream);
-    enb_byte_stream_init(&track_data_i16_byte_stream);
-    enb_byte_stream_init(&track_data_i32_byte_stream);
-    enb_byte_stream_init(&state_data_u2_byte_stream);
-    enb_byte_stream_init(&state_data_u8_byte_stream);
-    enb_byte_stream_init(&state_data_u16_byte_stream);
-    enb_byte_stream_init(&state_data_u32_byte_stream);
-    enb_anim_track_init_stream_copy_to_byte_stream(
-        &track_data_init_stream,
-        &track_data_init_i2_byte_stream,
-        &track_data_init_i8_byte_stream,
-        &track_data_init_i16_byte_stream,
-        &track_data_init_i32_byte_stream);
-    enb_anim_track_stream_copy_to_byte_stream(
-        &track_data_stream,
-        &track_data_i2_byte_stream,
-        &track_data_i4_byte_stream,
-        &track_data_i8_byte_stream,
-        &track_data_i16_byte_stream,
-        &track_data_i32_byte_stream);
-    enb_anim_state_stream_copy_to_byte_stream(
-        &state_data_stream,
-        &state_data_u2_byte_stream,
-        &state_data_u8_byte_stream,
-        &state_data_u16_byte_stream,
-        &state_data_u32_byte_stream);
-
-    size_t data_size = sizeof(enb_anim_stream);
-    data_size += enb_byte_stream_get_size(&track_data_init_i2_byte_stream);
-    data_size += enb_byte_stream_get_size(&track_data_init_i8_byte_stream);
-    data_size += enb_byte_stream_get_size(&track_data_init_i16_byte_stream);
-    data_size += enb_byte_stream_get_size(&track_data_init_i32_byte_stream);
-    data_size += enb_byte_stream_get_size(&track_data_i2_byte_stream);
-    data_size += enb_byte_stream_get_size(&track_data_i4_byte_stream);
-    data_size += enb_byte_stream_get_size(&track_data_i8_byte_stream);
-    data_size += enb_byte_stream_get_size(&track_data_i16_byte_stream);
-    data_size += enb_byte_stream_get_size(&track_data_i32_byte_stream);
-    data_size += enb_byte_stream_get_size(&state_data_u2_byte_stream);
-    data_size += enb_byte_stream_get_size(&state_data_u8_byte_stream);
-    data_size += enb_byte_stream_get_size(&state_data_u16_byte_stream);
-    data_size += enb_byte_stream_get_size(&state_data_u32_byte_stream);
-    data_size += enb_byte_stream_get_size(&track_flags_byte_stream);
-
-    *data_out = (uint8_t*)malloc(data_size);
-    if (!*data_out)
-        return;
+        &track_data_init_stream, &track_data_stream, &state_data_stream, &track_flags_byte_stream, &arena, f);
 
-    *data_out_len = data_size;
-
-    enb_anim_stream* anim_stream = (enb_anim_stream*)*data_out;
-    anim_stream->signature = 0;
-    anim_stream->duration = duration;
-    anim_stream->sample_rate = sample_rate;
-    anim_stream->track_count = num_tracks;
-    anim_stream->quantization_error = quantization_error + quantization_error;
-    anim_stream->track_data_init_i2_length = (uint32_t)enb_byte_stream_get_size(&track_data_init_i2_byte_stream);
-    anim_stream->track_data_init_i8_length = (uint32_t)enb_byte_stream_get_size(&track_data_init_i8_byte_stream);
-    anim_stream->track_data_init_i16_length = (uint32_t)enb_byte_stream_get_size(&track_data_init_i16_byte_stream);
-    anim_stream->track_data_init_i32_length = (uint32_t)enb_byte_stream_get_size(&track_data_init_i32_byte_stream);
-    anim_stream->track_data_i2_length = (uint32_t)enb_byte_stream_get_size(&track_data_i2_byte_stream);
-    anim_stream->track_data_i4_length = (uint32_t)enb_byte_stream_get_size(&track_data_i4_byte_stream);
-    anim_stream->track_data_i8_length = (uint32_t)enb_byte_stream_get_size(&track_data_i8_byte_stream);
-    anim_stream->track_data_i16_length = (uint32_t)enb_byte_stream_get_size(&track_data_i16_byte_stream);
-    anim_stream->track_data_i32_length = (uint32_t)enb_byte_stream_get_size(&track_data_i32_byte_stream);
-    anim_stream->state_data_u2_length = (uint32_t)enb_byte_stream_get_size(&state_data_u2_byte_stream);
-    anim_stream->state_data_u8_length = (uint32_t)enb_byte_stream_get_size(&state_data_u8_byte_stream);
-    anim_stream->state_data_u16_length = (uint32_t)enb_byte_stream_get_size(&state_data_u16_byte_stream);
-    anim_stream->state_data_u32_length = (uint32_t)enb_byte_stream_get_size(&state_data_u32_byte_stream);
-    anim_stream->track_flags_length = (uint32_t)enb_byte_stream_get_size(&track_flags_byte_stream);
-    anim_stream->data = (uint32_t)((size_t)*data_out + sizeof(enb_anim_stream));
-
-    if (enb_byte_stream_get_size(&track_data_init_i2_byte_stream))
-        memcpy(enb_anim_stream_get_track_data_init_i2(anim_stream),
-            enb_byte_stream_get_data(&track_data_init_i2_byte_stream),
-            enb_byte_stream_get_size(&track_data_init_i2_byte_stream));
-
-    if (enb_byte_stream_get_size(&track_data_init_i8_byte_stream))
-        memcpy(enb_anim_stream_get_track_data_init_i8(anim_stream),
-            enb_byte_stream_get_data(&track_data_init_i8_byte_stream),
-            enb_byte_stream_get_size(&track_data_init_i8_byte_stream));
-
-    if (enb_byte_stream_get_size(&track_data_init_i16_byte_stream))
-        memcpy(enb_anim_stream_get_track_data_init_i16(anim_stream),
-            enb_byte_stream_get_data(&track_data_init_i16_byte_stream),
-            enb_byte_stream_get_size(&track_data_init_i16_byte_stream));
-
-    if (enb_byte_stream_get_size(&track_data_init_i32_byte_stream))
-        memcpy(enb_anim_stream_get_track_data_init_i32(anim_stream),
-            enb_byte_stream_get_data(&track_data_init_i32_byte_stream),
-            enb_byte_stream_get_size(&track_data_init_i32_byte_stream));
-
-    if (enb_byte_stream_get_size(&track_data_i2_byte_stream))
-        memcpy(enb_anim_stream_get_track_data_i2(anim_stream),
-            enb_byte_stream_get_data(&track_data_i2_byte_stream),
-            enb_byte_stream_get_size(&track_data_i2_byte_stream));
-
-    if (enb_byte_stream_get_size(&track_data_i4_byte_stream))
-        memcpy(enb_anim_stream_get_track_data_i4(anim_stream),
-            enb_byte_stream_get_data(&track_data_i4_byte_stream),
-            enb_byte_stream_get_size(&track_data_i4_byte_stream));
-
-    if (enb_byte_stream_get_size(&track_data_i8_byte_stream))
-        memcpy(enb_anim_stream_get_track_data_i8(anim_stream),
-            enb_byte_stream_get_data(&track_data_i8_byte_stream),
-            enb_byte_stream_get_size(&track_data_i8_byte_stream));
-
-    if (enb_byte_stream_get_size(&track_data_i16_byte_stream))
-        memcpy(enb_anim_stream_get_track_data_i16(anim_stream),
-            enb_byte_stream_get_data(&track_data_i16_byte_stream),
-            enb_byte_stream_get_size(&track_data_i16_byte_stream));
-
-    if (enb_byte_stream_get_size(&track_data_i32_byte_stream))
-        memcpy(enb_anim_stream_get_track_data_i32(anim_stream),
-            enb_byte_stream_get_data(&track_data_i32_byte_stream),
-            enb_byte_stream_get_size(&track_data_i32_byte_stream));
-
-    if (enb_byte_stream_get_size(&state_data_u2_byte_stream))
-        memcpy(enb_anim_stream_get_state_data_u2(anim_stream),
-            enb_byte_stream_get_data(&state_data_u2_byte_stream),
-            enb_byte_stream_get_size(&state_data_u2_byte_stream));
-
-    if (enb_byte_stream_get_size(&state_data_u8_byte_stream))
-        memcpy(enb_anim_stream_get_state_data_u8(anim_stream),
-            enb_byte_stream_get_data(&state_data_u8_byte_stream),
-            enb_byte_stream_get_size(&state_data_u8_byte_stream));
-
-    if (enb_byte_stream_get_size(&state_data_u16_byte_stream))
-        memcpy(enb_anim_stream_get_state_data_u16(anim_stream),
-            enb_byte_stream_get_data(&state_data_u16_byte_stream),
-            enb_byte_stream_get_size(&state_data_u16_byte_stream));
-
-    if (enb_byte_stream_get_size(&state_data_u32_byte_stream))
-        memcpy(enb_anim_stream_get_state_data_u32(anim_stream),
-            enb_byte_stream_get_data(&state_data_u32_byte_stream),
-            enb_byte_stream_get_size(&state_data_u32_byte_stream));
-
-    if (enb_byte_stream_get_size(&track_flags_byte_stream))
-        memcpy(enb_anim_stream_get_track_flags(anim_stream),
-            enb_byte_stream_get_data(&track_flags_byte_stream),
-            enb_byte_stream_get_size(&track_flags_byte_stream));
+    enb_anim_stream_encoder_output(&track_data_init_stream, &track_data_stream, &state_data_stream,
+        &track_flags_byte_stream, num_tracks, duration, plain_anim, data_out, data_out_len);
 
     for (int32_t i = 0; i < num_tracks; i++)
-        if (tracks[i].samples) {
-            free(tracks[i].samples);
-            tracks[i].samples = 0;
+        if (tracks[i].value[0]) {
+            free(tracks[i].value[0]);
+            tracks[i].value[0] = 0;
         }
 
     if (tracks) {
@@ -1491,23 +5277,11 @@ static void enb_plain_anim_write_data(enb_plain_animation* plain_anim, int32_t n
         tracks = 0;
     }
 
-    enb_byte_stream_free(&state_data_u32_byte_stream);
-    enb_byte_stream_free(&state_data_u16_byte_stream);
-    enb_byte_stream_free(&state_data_u8_byte_stream);
-    enb_byte_stream_free(&state_data_u2_byte_stream);
-    enb_byte_stream_free(&track_data_i32_byte_stream);
-    enb_byte_stream_free(&track_data_i16_byte_stream);
-    enb_byte_stream_free(&track_data_i8_byte_stream);
-    enb_byte_stream_free(&track_data_i4_byte_stream);
-    enb_byte_stream_free(&track_data_i2_byte_stream);
-    enb_byte_stream_free(&track_data_init_i32_byte_stream);
-    enb_byte_stream_free(&track_data_init_i16_byte_stream);
-    enb_byte_stream_free(&track_data_init_i8_byte_stream);
-    enb_byte_stream_free(&track_data_init_i2_byte_stream);
     enb_byte_stream_free(&track_flags_byte_stream);
     enb_anim_state_stream_free(&state_data_stream);
     enb_anim_track_init_stream_free(&track_data_init_stream);
     enb_anim_track_stream_free(&track_data_stream);
+    enb_arena_free(&arena);
 }
 
 static void enb_plain_anim_free(enb_plain_animation* plain_anim) {
@@ -1567,146 +5341,164 @@ static void enb_byte_stream_set_size(enb_byte_stream* byte_stream, size_t value)
     byte_stream->base.size = value;
 }
 
-static void enb_octet_stream_alloc(enb_octet_stream* octet_stream) {
-    if (octet_stream->size) {
-        enb_byte_stream_set_size(octet_stream->byte_stream, octet_stream->size);
-        octet_stream->stream_count++;
+static void enb_arena_init(enb_arena* arena) {
+    arena->block = 0;
+}
+
+static uint8_t* enb_arena_alloc(enb_arena* arena, size_t size) {
+    enb_arena_block* block = arena->block;
+    size = (size + 0x0F) & ~(size_t)0x0F;
 
-        enb_byte_stream** stream_list = (enb_byte_stream**)realloc(octet_stream->stream_list,
-            sizeof(enb_byte_stream*) * octet_stream->stream_count);
-        if (!stream_list)
-            return;
+    if (!block || block->size - block->used < size) {
+        size_t block_size = size > 0x10000 ? size : 0x10000;
+        block = (enb_arena_block*)malloc(sizeof(enb_arena_block) + 0x10 + block_size);
+        if (!block)
+            return 0;
 
-        octet_stream->stream_list = stream_list;
-        octet_stream->stream_list[octet_stream->stream_count - 1] = octet_stream->byte_stream;
-        octet_stream->total_size += octet_stream->size;
+        block->next = arena->block;
+        block->size = block_size;
+        block->used = 0;
+        arena->block = block;
     }
-    else if (octet_stream->byte_stream)
-        return;
 
-    octet_stream->byte_stream = (enb_byte_stream*)malloc(sizeof(enb_byte_stream));
-    enb_byte_stream_alloc(octet_stream->byte_stream, 0x1000);
-    octet_stream->data = enb_byte_stream_get_data(octet_stream->byte_stream);
-    octet_stream->size = 0;
+    uint8_t* data = (uint8_t*)(((size_t)(block + 1) + 0x0F) & ~(size_t)0x0F) + block->used;
+    block->used += size;
+    return data;
 }
 
-static void enb_octet_stream_copy_to_byte_stream(enb_octet_stream* octet_stream, enb_byte_stream* byte_stream) {
-    enb_octet_stream_alloc(octet_stream);
-    enb_byte_stream_alloc(byte_stream, octet_stream->total_size);
-    enb_byte_stream_set_size(byte_stream, octet_stream->total_size);
+static bool enb_arena_extend(enb_arena* arena, uint8_t* data, size_t size, size_t new_size) {
+    enb_arena_block* block = arena->block;
+    if (!block || !data)
+        return false;
+
+    uint8_t* end = (uint8_t*)(((size_t)(block + 1) + 0x0F) & ~(size_t)0x0F) + block->used;
+    size = (size + 0x0F) & ~(size_t)0x0F;
+    new_size = (new_size + 0x0F) & ~(size_t)0x0F;
+    if (data + size != end || block->size - block->used < new_size - size)
+        return false;
+
+    block->used += new_size - size;
+    return true;
+}
+
+static void enb_arena_free(enb_arena* arena) {
+    enb_arena_block* block = arena->block;
+    while (block) {
+        enb_arena_block* next = block->next;
+        free(block);
+        block = next;
+    }
+    arena->block = 0;
+}
+
+static bool enb_octet_stream_grow(enb_octet_stream* octet_stream, size_t size) {
+    size_t capacity = octet_stream->capacity ? octet_stream->capacity : 0x100;
+    while (capacity < octet_stream->size + size)
+        capacity *= 2;
 
-    uint8_t* data = enb_byte_stream_get_data(byte_stream);
-    for (int32_t i = 0; i < octet_stream->stream_count; i++) {
-        size_t size = enb_byte_stream_get_size(octet_stream->stream_list[i]);
-        memcpy(data, enb_byte_stream_get_data(octet_stream->stream_list[i]), size);
-        data += size;
+    if (enb_arena_extend(octet_stream->arena, octet_stream->data, octet_stream->capacity, capacity)) {
+        octet_stream->capacity = (uint32_t)capacity;
+        return true;
     }
+
+    uint8_t* data = enb_arena_alloc(octet_stream->arena, capacity);
+    if (!data)
+        return false;
+
+    if (octet_stream->size)
+        memcpy(data, octet_stream->data, octet_stream->size);
+    octet_stream->data = data;
+    octet_stream->capacity = (uint32_t)capacity;
+    return true;
+}
+
+static void enb_octet_stream_copy_to_byte_stream(enb_octet_stream* octet_stream, enb_byte_stream* byte_stream) {
+    enb_byte_stream_alloc(byte_stream, octet_stream->size);
+    enb_byte_stream_set_size(byte_stream, octet_stream->size);
+
+    if (octet_stream->size)
+        memcpy(enb_byte_stream_get_data(byte_stream), octet_stream->data, octet_stream->size);
 }
 
-static void enb_octet_stream_init(enb_octet_stream* octet_stream) {
-    octet_stream->stream_list = 0;
-    octet_stream->stream_count = 0;
-    octet_stream->total_size = 0;
+static void enb_octet_stream_init(enb_octet_stream* octet_stream, enb_arena* arena) {
+    octet_stream->arena = arena;
     octet_stream->data = 0;
     octet_stream->size = 0;
-    octet_stream->byte_stream = 0;
-
-    enb_octet_stream_alloc(octet_stream);
+    octet_stream->capacity = 0;
 }
 
-static void enb_octet_stream_put_i8(enb_octet_stream* octet_stream, int8_t value) {
-    if (octet_stream->size + sizeof(int8_t) >= 0x1000)
-        enb_octet_stream_alloc(octet_stream);
+inline static void enb_octet_stream_put_i8(enb_octet_stream* octet_stream, int8_t value) {
+    if (octet_stream->size + sizeof(int8_t) > octet_stream->capacity
+        && !enb_octet_stream_grow(octet_stream, sizeof(int8_t)))
+        return;
 
-    *(int8_t*)octet_stream->data = value;
-    octet_stream->data += sizeof(int8_t);
+    *(int8_t*)(octet_stream->data + octet_stream->size) = value;
     octet_stream->size += sizeof(int8_t);
 }
 
-static void enb_octet_stream_put_u8(enb_octet_stream* octet_stream, uint8_t value) {
-    if (octet_stream->size + sizeof(uint8_t) >= 0x1000)
-        enb_octet_stream_alloc(octet_stream);
+inline static void enb_octet_stream_put_u8(enb_octet_stream* octet_stream, uint8_t value) {
+    if (octet_stream->size + sizeof(uint8_t) > octet_stream->capacity
+        && !enb_octet_stream_grow(octet_stream, sizeof(uint8_t)))
+        return;
 
-    *(uint8_t*)octet_stream->data = value;
-    octet_stream->data += sizeof(uint8_t);
+    *(uint8_t*)(octet_stream->data + octet_stream->size) = value;
     octet_stream->size += sizeof(uint8_t);
 }
 
-static void enb_octet_stream_put_i16(enb_octet_stream* octet_stream, int16_t value) {
-    if (octet_stream->size + sizeof(int16_t) >= 0x1000)
-        enb_octet_stream_alloc(octet_stream);
+inline static void enb_octet_stream_put_i16(enb_octet_stream* octet_stream, int16_t value) {
+    if (octet_stream->size + sizeof(int16_t) > octet_stream->capacity
+        && !enb_octet_stream_grow(octet_stream, sizeof(int16_t)))
+        return;
 
-    *(int16_t*)octet_stream->data = value;
-    octet_stream->data += sizeof(int16_t);
+    *(int16_t*)(octet_stream->data + octet_stream->size) = value;
     octet_stream->size += sizeof(int16_t);
 }
 
-static void enb_octet_stream_put_u16(enb_octet_stream* octet_stream, uint16_t value) {
-    if (octet_stream->size + sizeof(uint16_t) >= 0x1000)
-        enb_octet_stream_alloc(octet_stream);
+inline static void enb_octet_stream_put_u16(enb_octet_stream* octet_stream, uint16_t value) {
+    if (octet_stream->size + sizeof(uint16_t) > octet_stream->capacity
+        && !enb_octet_stream_grow(octet_stream, sizeof(uint16_t)))
+        return;
 
-    *(uint16_t*)octet_stream->data = value;
-    octet_stream->data += sizeof(uint16_t);
+    *(uint16_t*)(octet_stream->data + octet_stream->size) = value;
     octet_stream->size += sizeof(uint16_t);
 }
 
-static void enb_octet_stream_put_i32(enb_octet_stream* octet_stream, int32_t value) {
-    if (octet_stream->size + sizeof(int32_t) >= 0x1000)
-        enb_octet_stream_alloc(octet_stream);
+inline static void enb_octet_stream_put_i32(enb_octet_stream* octet_stream, int32_t value) {
+    if (octet_stream->size + sizeof(int32_t) > octet_stream->capacity
+        && !enb_octet_stream_grow(octet_stream, sizeof(int32_t)))
+        return;
 
-    *(int32_t*)octet_stream->data = value;
-    octet_stream->data += sizeof(int32_t);
+    *(int32_t*)(octet_stream->data + octet_stream->size) = value;
     octet_stream->size += sizeof(int32_t);
 }
 
-static void enb_octet_stream_put_u32(enb_octet_stream* octet_stream, uint32_t value) {
-    if (octet_stream->size + sizeof(uint32_t) >= 0x1000)
-        enb_octet_stream_alloc(octet_stream);
+inline static void enb_octet_stream_put_u32(enb_octet_stream* octet_stream, uint32_t value) {
+    if (octet_stream->size + sizeof(uint32_t) > octet_stream->capacity
+        && !enb_octet_stream_grow(octet_stream, sizeof(uint32_t)))
+        return;
 
-    *(uint32_t*)octet_stream->data = value;
-    octet_stream->data += sizeof(uint32_t);
+    *(uint32_t*)(octet_stream->data + octet_stream->size) = value;
     octet_stream->size += sizeof(uint32_t);
 }
 
-static void enb_octet_stream_reset(enb_octet_stream* octet_stream) {
-    if (octet_stream->stream_list) {
-        for (int32_t i = 0; i < octet_stream->stream_count; i++)
-            if (octet_stream->stream_list[i]) {
-                enb_byte_stream_free(octet_stream->stream_list[i]);
-                free(octet_stream->stream_list[i]);
-                octet_stream->stream_list[i] = 0;
-            }
-
-        free(octet_stream->stream_list);
-        octet_stream->stream_list = 0;
-    }
-    octet_stream->stream_count = 0;
-
-    if (octet_stream->byte_stream) {
-        enb_byte_stream_free(octet_stream->byte_stream);
-        free(octet_stream->byte_stream);
-        octet_stream->byte_stream = 0;
-    }
-
-    octet_stream->total_size = 0;
-    octet_stream->data = 0;
-    octet_stream->size = 0;
+static uint8_t* enb_octet_stream_put_span(enb_octet_stream* octet_stream, size_t size) {
+    if (octet_stream->size + size > octet_stream->capacity
+        && !enb_octet_stream_grow(octet_stream, size))
+        return 0;
 
-    enb_octet_stream_alloc(octet_stream);
+    uint8_t* data = octet_stream->data + octet_stream->size;
+    octet_stream->size += (uint32_t)size;
+    return data;
 }
 
 static void enb_octet_stream_free(enb_octet_stream* octet_stream) {
-    enb_octet_stream_reset(octet_stream);
-
-    if (octet_stream->byte_stream) {
-        enb_byte_stream_free(octet_stream->byte_stream);
-        free(octet_stream->byte_stream);
-        octet_stream->byte_stream = 0;
-    }
+    octet_stream->data = 0;
+    octet_stream->size = 0;
+    octet_stream->capacity = 0;
 }
 
-static void enb_bit_octet_stream_init(enb_bit_octet_stream* bit_octet_stream) {
-    enb_octet_stream_init(&bit_octet_stream->base);
+static void enb_bit_octet_stream_init(enb_bit_octet_stream* bit_octet_stream, enb_arena* arena) {
+    enb_octet_stream_init(&bit_octet_stream->base, arena);
     bit_octet_stream->u2_counter = 0;
     bit_octet_stream->u4_counter = 0;
     bit_octet_stream->temp = 0;
@@ -1741,11 +5533,11 @@ static void enb_bit_octet_stream_free(enb_bit_octet_stream* bit_octet_stream) {
     enb_octet_stream_free(&bit_octet_stream->base);
 }
 
-static void enb_anim_track_init_stream_init(enb_anim_track_init_stream* track_init_stream) {
-    enb_bit_octet_stream_init(&track_init_stream->i2_stream);
-    enb_octet_stream_init(&track_init_stream->i8_stream);
-    enb_octet_stream_init(&track_init_stream->i16_stream);
-    enb_octet_stream_init(&track_init_stream->i32_stream);
+static void enb_anim_track_init_stream_init(enb_anim_track_init_stream* track_init_stream, enb_arena* arena) {
+    enb_bit_octet_stream_init(&track_init_stream->i2_stream, arena);
+    enb_octet_stream_init(&track_init_stream->i8_stream, arena);
+    enb_octet_stream_init(&track_init_stream->i16_stream, arena);
+    enb_octet_stream_init(&track_init_stream->i32_stream, arena);
 }
 
 static void enb_anim_track_init_stream_copy_to_byte_stream(enb_anim_track_init_stream* track_init_stream,
@@ -1781,12 +5573,13 @@ static void enb_anim_track_init_stream_free(enb_anim_track_init_stream* track_in
     enb_bit_octet_stream_free(&track_init_stream->i2_stream);
 }
 
-static void enb_anim_track_stream_init(enb_anim_track_stream* track_stream) {
-    enb_bit_octet_stream_init(&track_stream->i2_stream);
-    enb_bit_octet_stream_init(&track_stream->i4_stream);
-    enb_octet_stream_init(&track_stream->i8_stream);
-    enb_octet_stream_init(&track_stream->i16_stream);
-    enb_octet_stream_init(&track_stream->i32_stream);
+static void enb_anim_track_stream_init(enb_anim_track_stream* track_stream, enb_arena* arena) {
+    enb_bit_octet_stream_init(&track_stream->i2_stream, arena);
+    enb_bit_octet_stream_init(&track_stream->i4_stream, arena);
+    enb_octet_stream_init(&track_stream->i8_stream, arena);
+    enb_octet_stream_init(&track_stream->i16_stream, arena);
+    enb_octet_stream_init(&track_stream->i32_stream, arena);
+    track_stream->count = 0;
 }
 
 static void enb_anim_track_stream_copy_to_byte_stream(enb_anim_track_stream* track_stream,
@@ -1800,6 +5593,7 @@ static void enb_anim_track_stream_copy_to_byte_stream(enb_anim_track_stream* tra
 }
 
 static void enb_anim_track_stream_put_value(enb_anim_track_stream* track_stream, int32_t value) {
+    track_stream->count++;
     if (value >= -0x01 && value <= 0x01) {
         enb_bit_octet_stream_put_u2(&track_stream->i2_stream, (uint8_t)value);
         return;
@@ -1837,6 +5631,37 @@ static void enb_anim_track_stream_put_value(enb_anim_track_stream* track_stream,
     enb_octet_stream_put_i32(&track_stream->i32_stream, value);
 }
 
+static void enb_anim_track_stream_entropy_code(enb_anim_track_stream* track_stream,
+    enb_byte_stream* i2_stream, enb_byte_stream* i4_stream, enb_byte_stream* i8_stream,
+    enb_byte_stream* i16_stream, enb_byte_stream* i32_stream, enb_byte_stream* entropy_stream) {
+    const uint32_t count = track_stream->count;
+    int32_t* values = (int32_t*)malloc(sizeof(int32_t) * (count ? count : 1));
+    if (!values) {
+        enb_byte_stream_init(entropy_stream);
+        return;
+    }
+
+    enb_anim_track_data_decoder track_data;
+    track_data.i2 = enb_byte_stream_get_data(i2_stream);
+    track_data.i4 = enb_byte_stream_get_data(i4_stream);
+    track_data.i8 = (const int8_t*)enb_byte_stream_get_data(i8_stream);
+    track_data.i16 = (const int16_t*)enb_byte_stream_get_data(i16_stream);
+    track_data.i32 = (const int32_t*)enb_byte_stream_get_data(i32_stream);
+    track_data.i2_counter = 0;
+    track_data.i4_counter = 0;
+    for (uint32_t i = 0; i < count; i++)
+        values[i] = enb_anim_track_data_forward_decode(&track_data);
+
+    enb_byte_stream_free(i2_stream);
+    enb_byte_stream_free(i4_stream);
+    enb_byte_stream_free(i8_stream);
+    enb_byte_stream_free(i16_stream);
+    enb_byte_stream_free(i32_stream);
+
+    enb_anim_rans_encode(values, count, entropy_stream, i8_stream, i16_stream, i32_stream);
+    free(values);
+}
+
 static void enb_anim_track_stream_free(enb_anim_track_stream* track_stream) {
     enb_octet_stream_free(&track_stream->i32_stream);
     enb_octet_stream_free(&track_stream->i16_stream);
@@ -1845,11 +5670,11 @@ static void enb_anim_track_stream_free(enb_anim_track_stream* track_stream) {
     enb_bit_octet_stream_free(&track_stream->i2_stream);
 }
 
-static void enb_anim_state_stream_init(enb_anim_state_stream* state_stream) {
-    enb_bit_octet_stream_init(&state_stream->u2_stream);
-    enb_octet_stream_init(&state_stream->u8_stream);
-    enb_octet_stream_init(&state_stream->u16_stream);
-    enb_octet_stream_init(&state_stream->u32_stream);
+static void enb_anim_state_stream_init(enb_anim_state_stream* state_stream, enb_arena* arena) {
+    enb_bit_octet_stream_init(&state_stream->u2_stream, arena);
+    enb_octet_stream_init(&state_stream->u8_stream, arena);
+    enb_octet_stream_init(&state_stream->u16_stream, arena);
+    enb_octet_stream_init(&state_stream->u32_stream, arena);
 }
 
 static void enb_anim_state_stream_copy_to_byte_stream(enb_anim_state_stream* state_stream,
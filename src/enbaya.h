@@ -15,6 +15,14 @@ typedef struct {
     uint8_t padding[3];
 } enb_track;
 
+#define ENB_SIGNATURE_SPLIT_QUANTIZATION 0x01                // Per track rotation/translation steps after track flags
+#define ENB_SIGNATURE_SMALLEST_THREE 0x02                    // Per track dropped quaternion component table
+#define ENB_SIGNATURE_ENTROPY_CODED 0x04                     // rANS coded track data replaces i2/i4/i8/i16/i32
+#define ENB_SIGNATURE_PREDICTOR 0x08                         // Per track component predictor order table
+#define ENB_SIGNATURE_RESTART 0x10                           // Decoder state table every restart interval samples
+#define ENB_SIGNATURE_MASK (ENB_SIGNATURE_SPLIT_QUANTIZATION | ENB_SIGNATURE_SMALLEST_THREE \
+    | ENB_SIGNATURE_ENTROPY_CODED | ENB_SIGNATURE_PREDICTOR | ENB_SIGNATURE_RESTART)
+
 typedef struct  __attribute__((aligned(4))) {
     uint32_t signature;                                     // 0x00
     uint32_t track_count;                                   // 0x04
@@ -91,6 +99,10 @@ typedef struct {
     const uint32_t* u32;                                    // 0x0C
 } enb_anim_state_data;
 
+typedef struct enb_anim_rans_decoder enb_anim_rans_decoder;
+typedef struct enb_anim_predictor_reader enb_anim_predictor_reader;
+typedef struct enb_anim_restart_header enb_anim_restart_header;
+
 typedef struct __attribute__((aligned(8))) {
     uint32_t current_sample;                                // 0x00
     float_t current_sample_time;                            // 0x04
@@ -115,15 +127,160 @@ typedef struct __attribute__((aligned(8))) {
     enb_anim_state_data state_data;                         // 0x98
     uint8_t track_direction;                                // 0xA8
     uint8_t track_selector;                                 // 0xA9
+    const float_t* rotation_quantization_error;             // 0xAC
+    const float_t* translation_quantization_error;          // 0xB0
+    const uint8_t* dropped_component;                       // 0xB4
+    enb_anim_rans_decoder* rans;                            // 0xB8
+    const uint16_t* predictor;                              // 0xBC
+    uint8_t* static_track;                                  // 0xC0
+    int32_t static_track_count;                             // 0xC4
+    uint8_t* track_mask;                                    // 0xC8
+    uint32_t sample_count;                                  // 0xCC
+    uint8_t seek_pending;                                   // 0xD0
+    uint32_t seek_sample;                                   // 0xD4
+    float_t seek_time;                                      // 0xD8
+    float_t seek_pose_time;                                 // 0xDC
+    quat_trans* seek_pose;                                  // 0xE0, previous then next pose of every track
+    const enb_anim_restart_header* restart;                 // 0xE4
+    enb_anim_predictor_reader* predictor_reader;            // 0xE8
 } enb_anim_context;
 
+typedef struct enb_encode_context enb_encode_context;
+
+typedef struct enb_pose_cache enb_pose_cache;
+typedef struct enb_prefetch enb_prefetch;
+typedef struct enb_baked_clip enb_baked_clip;
+
+#define ENB_BAKE_NONE 0
+#define ENB_BAKE_FLOAT 1                                     // 32 byte float poses
+#define ENB_BAKE_INT16 2                                     // 16 byte poses, translations scaled to each track's range
+
+#define ENB_OUTPUT_QUAT_TRANS 0
+#define ENB_OUTPUT_MATRIX 1                                  // 48 byte row-major 3x4 matrices, no frame times
+
+typedef struct {
+    float_t m[3][4];                                        // Rotation times scale, translation in the last column
+} enb_matrix3x4;
+
+typedef struct {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    size_t memory_limit;                                    // Bytes
+    size_t memory_used;
+    uint32_t entry_count;
+} enb_pose_cache_stats;
+
+typedef struct {
+    float_t rotation_quantization_error;
+    float_t translation_quantization_error;
+    const float_t* track_rotation_quantization_error;       // Optional, one per track
+    const float_t* track_translation_quantization_error;    // Optional, one per track
+    uint32_t signature;                                     // Opt-in ENB_SIGNATURE_SMALLEST_THREE/ENTROPY_CODED/PREDICTOR
+    uint32_t restart_interval;                              // Samples between restart points, 0 writes none
+} enb_encode_options;
+
+typedef struct {
+    float_t start;                                          // Seconds, clamped to the clip
+    float_t end;                                            // Seconds, 0 decodes to the end of the clip
+    const int32_t* tracks;                                  // Optional, decodes only these tracks in this order
+    int32_t num_tracks;
+    int32_t bake;                                           // ENB_BAKE_*, samples a baked table instead of the stream
+    int32_t output;                                         // ENB_OUTPUT_*
+    const vec3* scale;                                      // Optional, one per track of the stream, matrices only
+    int32_t num_threads;                                    // Splits the frames when the stream has restart points
+} enb_process_options;
+
+typedef struct {
+    enb_anim_context* context;
+    float_t time;
+} enb_anim_instance;
+
+#define ENB_SECTION_COUNT 14
+
+typedef struct {
+    float_t rotation_max_error;                             // Radians
+    float_t rotation_rms_error;
+    float_t translation_max_error;
+    float_t translation_rms_error;
+} enb_track_error;
+
+typedef struct {
+    size_t data_len;
+    uint32_t section_length[ENB_SECTION_COUNT];             // In enb_anim_stream length field order
+    int32_t track_count;
+    int32_t sample_count;
+    int32_t rotation_flips;                                 // Keys negated to keep neighbouring rotations in one hemisphere
+    enb_track_error error;
+    enb_track_error* track_error;
+} enb_verify_result;
+
 extern int32_t enb_process(uint8_t* data_in, uint8_t** data_out, size_t* data_out_len, float_t* duration,
     float_t* fps, int32_t* frames, quat_trans_interp_method quat_method, quat_trans_interp_method trans_method);
+extern int32_t enb_process_ex(uint8_t* data_in, uint8_t** data_out, size_t* data_out_len, float_t* duration,
+    float_t* fps, int32_t* frames, const enb_process_options* options,
+    quat_trans_interp_method quat_method, quat_trans_interp_method trans_method);
+extern int32_t enb_process_tracks(uint8_t* data_in, uint8_t** data_out, size_t* data_out_len, float_t* duration,
+    float_t* fps, int32_t* frames, const int32_t* tracks, int32_t num_tracks,
+    quat_trans_interp_method quat_method, quat_trans_interp_method trans_method);
 extern int32_t enb_initialize(uint8_t* data, enb_anim_context** anim_ctx);
 extern void enb_free(enb_anim_context** anim_ctx);
 extern void enb_get_component_values(enb_anim_context* anim_ctx, float_t time, int32_t track_id,
     quat_trans* data, quat_trans_interp_method quat_method, quat_trans_interp_method trans_method);
+extern void enb_get_sample_values(enb_anim_context* anim_ctx, float_t sample, int32_t track_id,
+    quat_trans* data, quat_trans_interp_method quat_method, quat_trans_interp_method trans_method);
+extern int32_t enb_get_component_values_batch(enb_anim_context* anim_ctx, const float_t* times, int32_t num_times,
+    const int32_t* tracks, int32_t num_tracks, quat_trans* data,
+    quat_trans_interp_method quat_method, quat_trans_interp_method trans_method);
+extern int32_t enb_get_matrices(enb_anim_context* anim_ctx, float_t time, const int32_t* tracks, int32_t num_tracks,
+    const vec3* scale, enb_matrix3x4* data, quat_trans_interp_method quat_method, quat_trans_interp_method trans_method);
+extern int32_t enb_get_instances_values(const enb_anim_instance* instances, int32_t num_instances,
+    quat_trans* data, quat_trans_interp_method quat_method, quat_trans_interp_method trans_method);
+extern int32_t enb_pose_cache_create(size_t memory_limit, enb_pose_cache** cache);
+extern void enb_pose_cache_free(enb_pose_cache** cache);
+extern void enb_pose_cache_clear(enb_pose_cache* cache, const enb_anim_context* anim_ctx);
+extern void enb_pose_cache_get_stats(enb_pose_cache* cache, enb_pose_cache_stats* stats);
+extern int32_t enb_pose_cache_get_values(enb_pose_cache* cache, enb_anim_context* anim_ctx, float_t time,
+    quat_trans* data, quat_trans_interp_method quat_method, quat_trans_interp_method trans_method);
+extern int32_t enb_prefetch_create(uint8_t* data, int32_t capacity, enb_prefetch** prefetch);
+extern void enb_prefetch_free(enb_prefetch** prefetch);
+extern int32_t enb_prefetch_get_values(enb_prefetch* prefetch, float_t time, quat_trans* data,
+    quat_trans_interp_method quat_method, quat_trans_interp_method trans_method);
+extern int32_t enb_seek_time_budget(enb_anim_context* anim_ctx, float_t time, int32_t max_samples);
+extern int32_t enb_get_seek_values(enb_anim_context* anim_ctx, int32_t track_id,
+    quat_trans* data, quat_trans_interp_method quat_method, quat_trans_interp_method trans_method);
+extern int32_t enb_baked_create(uint8_t* data, int32_t format, enb_baked_clip** baked);
+extern void enb_baked_free(enb_baked_clip** baked);
+extern size_t enb_baked_get_size(const enb_baked_clip* baked);
+extern int32_t enb_baked_get_values(const enb_baked_clip* baked, float_t time, int32_t track_id,
+    quat_trans* data, quat_trans_interp_method quat_method, quat_trans_interp_method trans_method);
+extern int32_t enb_decode_samples(uint8_t* data, int32_t num_threads, quat_trans* data_out);
+extern int32_t enb_get_sample_count(enb_anim_context* anim_ctx);
+extern int32_t enb_seek_sample(enb_anim_context* anim_ctx, uint32_t sample);
+extern int32_t enb_step_forward(enb_anim_context* anim_ctx);
+extern int32_t enb_step_backward(enb_anim_context* anim_ctx);
+extern int32_t enb_get_static_tracks(enb_anim_context* anim_ctx, uint8_t* static_tracks);
+extern int32_t enb_set_track_mask(enb_anim_context* anim_ctx, const uint8_t* track_mask);
 extern int32_t enb_encode_data(quat_trans* track_data, int32_t* track_data_count, int32_t num_tracks,
     int32_t num_components, float_t duration, int32_t sample_rate, float_t quantization_error,
     quat_trans_interp_method quat_method, quat_trans_interp_method trans_method,
     uint8_t** data_out, size_t* data_out_len);
+extern int32_t enb_encode_data_ex(quat_trans* track_data, int32_t* track_data_count, int32_t num_tracks,
+    int32_t num_components, float_t duration, int32_t sample_rate, const enb_encode_options* options,
+    quat_trans_interp_method quat_method, quat_trans_interp_method trans_method,
+    uint8_t** data_out, size_t* data_out_len);
+extern int32_t enb_encode_begin(int32_t num_tracks, int32_t num_components, int32_t sample_rate,
+    float_t quantization_error, quat_trans_interp_method quat_method, quat_trans_interp_method trans_method,
+    enb_encode_context** enc_ctx);
+extern int32_t enb_encode_begin_ex(int32_t num_tracks, int32_t num_components, int32_t sample_rate,
+    const enb_encode_options* options, quat_trans_interp_method quat_method, quat_trans_interp_method trans_method,
+    enb_encode_context** enc_ctx);
+extern int32_t enb_encode_push_frames(enb_encode_context* enc_ctx, quat_trans* frames, int32_t num_frames);
+extern int32_t enb_encode_finish(enb_encode_context* enc_ctx, uint8_t** data_out, size_t* data_out_len);
+extern int32_t enb_encode_get_rotation_flips(enb_encode_context* enc_ctx);
+extern void enb_encode_free(enb_encode_context** enc_ctx);
+extern int32_t enb_verify_data(quat_trans* track_data, int32_t* track_data_count, int32_t num_tracks,
+    int32_t num_components, float_t duration, int32_t sample_rate, const enb_encode_options* options,
+    quat_trans_interp_method quat_method, quat_trans_interp_method trans_method,
+    int32_t num_threads, enb_verify_result* result);
+extern void enb_verify_free(enb_verify_result* result);
@@ -5,28 +5,352 @@
 
 #include "enbrip.h"
 
+static int32_t read_file(const char* file_name, uint8_t** data, size_t* data_len);
+static int32_t write_file(const char* file_name, uint8_t* data, size_t data_len);
+static bool file_exists(const char* file_name);
+static char* get_file_out_name(const char* file_in_name, const char* ext);
+static int32_t read_frames(const char* file_name, uint8_t** data, size_t* data_len,
+    quat_trans** qt_data, int32_t* tracks, int32_t* frames);
+static void parse_quantization(const char* arg, enb_encode_options* options);
+static int32_t parse_switches(int argc, char** argv, uint32_t* signature, uint32_t* restart_interval);
+static int32_t parse_process_options(int argc, char** argv, enb_process_options* options, int32_t** tracks,
+    const char** invalid);
+static int32_t get_track_data(const quat_trans* qt_data, int32_t tracks, int32_t frames,
+    quat_trans** track_data, int32_t** track_data_count);
+static int32_t decode(int argc, char** argv);
+static int32_t encode(int argc, char** argv);
+static int32_t verify(int argc, char** argv);
+
 int main(int argc, char** argv) {
-    FILE* file_in, * file_out;
-    char* file_in_name, * file_out_name, * p;
+    if (argc > 1 && !strcmp(argv[1], "encode"))
+        return encode(argc - 1, argv + 1);
+    else if (argc > 1 && !strcmp(argv[1], "verify"))
+        return verify(argc - 1, argv + 1);
+    return decode(argc, argv);
+}
+
+static int32_t read_file(const char* file_name, uint8_t** data, size_t* data_len) {
+    FILE* file;
+    int32_t code;
+
+    *data = 0;
+    *data_len = 0;
+    code = 0;
+
+    file = fopen(file_name, "rb");
+    if (!file)
+        exit("Can't open file \"%s\" for read", file_name, -4)
+
+    fseek(file, 0, SEEK_END);
+    *data_len = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    *data = (uint8_t*)malloc(*data_len);
+    if (!*data) {
+        fclose(file);
+        exit(cant_allocate, "file_in_data", -5)
+    }
+
+    if (fread(*data, 1, *data_len, file) != *data_len)
+        if (fclose(file))
+            exit("Can't read entire file \"%s\"and close it\n", file_name, -6)
+        else
+            exit("Can't read entire file \"%s\"\n", file_name, -7)
+
+    if (fclose(file))
+        exit("Can't close input file \"%s\"\n", file_name, -8)
+
+End:
+    return code;
+}
+
+static int32_t write_file(const char* file_name, uint8_t* data, size_t data_len) {
+    FILE* file;
+    int32_t code;
+
+    code = 0;
+
+    file = fopen(file_name, "wb");
+    if (!file)
+        exit("Can't open file \"%s\" for write\n", file_name, -9)
+
+    if (fwrite(data, 1, data_len, file) != data_len)
+        if (fclose(file))
+            exit("Can't write entire file \"%s\" and close it\n", file_name, -10)
+        else
+            exit("Can't write entire file \"%s\"\n", file_name, -11)
+
+    if (fclose(file))
+        exit("Can't close output file \"%s\"\n", file_name, -12)
+
+End:
+    return code;
+}
+
+static bool file_exists(const char* file_name) {
+    FILE* file;
+
+    file = fopen(file_name, "rb");
+    if (!file)
+        return false;
+
+    fclose(file);
+    return true;
+}
+
+static char* get_file_out_name(const char* file_in_name, const char* ext) {
+    size_t file_out_name_len, ext_len;
+    char* file_out_name;
+    const char* p;
+
+    p = strrchr(file_in_name, '.');
+    if (p)
+        file_out_name_len = p - file_in_name;
+    else
+        file_out_name_len = strlen(file_in_name);
+
+    ext_len = strlen(ext);
+    file_out_name = (char*)malloc(file_out_name_len + ext_len + 1);
+    if (!file_out_name)
+        return 0;
+
+    memcpy(file_out_name, file_in_name, file_out_name_len);
+    memcpy(file_out_name + file_out_name_len, ext, ext_len + 1);
+    return file_out_name;
+}
+
+static int32_t read_frames(const char* file_name, uint8_t** data, size_t* data_len,
+    quat_trans** qt_data, int32_t* tracks, int32_t* frames) {
+    const char* p;
+    int32_t code;
+
+    code = read_file(file_name, data, data_len);
+    if (code)
+        return code;
+
+    p = strrchr(file_name, '.');
+    if (p && !strcmp(p, ".rtrd")) {
+        if (*data_len < 0x10)
+            exit("Input file \"%s\" is too small\n", file_name, -13)
+
+        *tracks = ((int32_t*)*data)[0];
+        *frames = ((int32_t*)*data)[1];
+        *qt_data = (quat_trans*)(*data + 0x10);
+        if (*tracks < 1 || *frames < 1
+            || (*data_len - 0x10) / sizeof(quat_trans) / *tracks < (size_t)*frames)
+            exit("Input file \"%s\" is malformed\n", file_name, -14)
+    }
+    else {
+        if (*tracks < 1)
+            exit("Track count is required for raw file \"%s\"\n", file_name, -15)
+
+        *frames = (int32_t)(*data_len / sizeof(quat_trans) / *tracks);
+        *qt_data = (quat_trans*)*data;
+        if (*frames < 1)
+            exit("Input file \"%s\" is too small\n", file_name, -13)
+    }
+
+End:
+    return code;
+}
+
+static void parse_quantization(const char* arg, enb_encode_options* options) {
+    const char* p;
+
+    memset(options, 0, sizeof(enb_encode_options));
+    options->rotation_quantization_error = arg ? (float_t)atof(arg) : 0.0005f;
+    if (options->rotation_quantization_error <= 0.0f)
+        options->rotation_quantization_error = 0.0005f;
+
+    p = arg ? strchr(arg, ':') : 0;
+    options->translation_quantization_error = p ? (float_t)atof(p + 1) : 0.0f;
+    if (options->translation_quantization_error <= 0.0f)
+        options->translation_quantization_error = options->rotation_quantization_error;
+}
+
+static int32_t parse_switches(int argc, char** argv, uint32_t* signature, uint32_t* restart_interval) {
+    int32_t i, j;
+
+    *signature = 0;
+    *restart_interval = 0;
+    for (i = 1, j = 1; i < argc; i++)
+        if (!strcmp(argv[i], "--smallest-three"))
+            *signature |= ENB_SIGNATURE_SMALLEST_THREE;
+        else if (!strcmp(argv[i], "--entropy"))
+            *signature |= ENB_SIGNATURE_ENTROPY_CODED;
+        else if (!strcmp(argv[i], "--predictor"))
+            *signature |= ENB_SIGNATURE_PREDICTOR;
+        else if (i + 1 < argc && !strcmp(argv[i], "--restart")) {
+            int32_t interval = atoi(argv[++i]);
+            *restart_interval = interval > 0 ? interval : 0;
+        }
+        else
+            argv[j++] = argv[i];
+    return j;
+}
+
+// Returns the remaining argument count, or -1 for an option without its value, -2 for an invalid
+// track list, -3 for an invalid bake format, -4 when out of memory and -5 for a thread count below 1,
+// with *invalid set to the value or to the option missing it
+static int32_t parse_process_options(int argc, char** argv, enb_process_options* options, int32_t** tracks,
+    const char** invalid) {
+    int32_t i, j, first, last, count;
+    int32_t* temp;
+    const char* p;
+    char* end;
+
+    memset(options, 0, sizeof(enb_process_options));
+    *tracks = 0;
+    for (i = 1, j = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--matrix")) {
+            options->output = ENB_OUTPUT_MATRIX;
+            continue;
+        }
+        else if (strcmp(argv[i], "--start") && strcmp(argv[i], "--end") && strcmp(argv[i], "--bake")
+            && strcmp(argv[i], "--threads") && strcmp(argv[i], "--tracks")) {
+            argv[j++] = argv[i];
+            continue;
+        }
+        else if (i + 1 >= argc) {
+            *invalid = argv[i];
+            return -1;
+        }
+
+        p = argv[++i];
+        *invalid = p;
+        if (!strcmp(argv[i - 1], "--start")) {
+            options->start = (float_t)atof(p);
+            continue;
+        }
+        else if (!strcmp(argv[i - 1], "--end")) {
+            options->end = (float_t)atof(p);
+            continue;
+        }
+        else if (!strcmp(argv[i - 1], "--threads")) {
+            options->num_threads = (int32_t)strtol(p, &end, 10);
+            if (end == p || *end || options->num_threads < 1)
+                return -5;
+            continue;
+        }
+        else if (!strcmp(argv[i - 1], "--bake")) {
+            if (!strcmp(p, "float"))
+                options->bake = ENB_BAKE_FLOAT;
+            else if (!strcmp(p, "int16"))
+                options->bake = ENB_BAKE_INT16;
+            else
+                return -3;
+            continue;
+        }
+
+        // Accepts comma separated indices and inclusive ranges, e.g. 0,3,5-9
+        count = 0;
+        if (!*p)
+            return -2;
+
+        while (*p) {
+            first = (int32_t)strtol(p, &end, 10);
+            last = *end == '-' ? (int32_t)strtol(end + 1, &end, 10) : first;
+            if (end == p || last < first)
+                return -2;
+
+            temp = (int32_t*)realloc(*tracks, sizeof(int32_t) * (count + last - first + 1));
+            if (!temp)
+                return -4;
+            *tracks = temp;
+
+            while (first <= last)
+                (*tracks)[count++] = first++;
+
+            p = *end == ',' ? end + 1 : end;
+            if (*end && *end != ',')
+                return -2;
+        }
+        options->tracks = *tracks;
+        options->num_tracks = count;
+    }
+    return j;
+}
+
+static int32_t get_track_data(const quat_trans* qt_data, int32_t tracks, int32_t frames,
+    quat_trans** track_data, int32_t** track_data_count) {
+    int32_t code, i, j;
+
+    code = 0;
+    *track_data = (quat_trans*)malloc(sizeof(quat_trans) * tracks * frames);
+    if (!*track_data)
+        exit(cant_allocate, "track_data", -16)
+
+    *track_data_count = (int32_t*)malloc(sizeof(int32_t) * tracks);
+    if (!*track_data_count)
+        exit(cant_allocate, "track_data_count", -17)
+
+    for (i = 0; i < tracks; i++) {
+        (*track_data_count)[i] = frames;
+        for (j = 0; j < frames; j++)
+            (*track_data)[i * frames + j] = qt_data[j * tracks + i];
+    }
+
+End:
+    return code;
+}
+
+static int32_t decode(int argc, char** argv) {
+    char* file_in_name, * file_out_name;
     uint8_t* file_in_data, * file_out_data;
     int32_t code, frames;
-    size_t file_in_len, file_in_name_len, file_out_len, file_out_name_len;
+    size_t file_in_len, file_out_len;
     float duration, fps;
     int32_t method;
+    int32_t* tracks;
+    const char* invalid;
+    enb_process_options options;
 
-    file_in = file_out = (FILE*)0;
-    file_in_name = file_out_name = p = (char*)0;
+    file_in_name = file_out_name = (char*)0;
     file_in_data = file_out_data = (uint8_t*)0;
+    tracks = 0;
+    invalid = 0;
     code = frames = 0;
-    file_in_len = file_in_name_len = file_out_len = file_out_name_len = 0;
+    file_in_len = file_out_len = 0;
     duration = fps = 0.0f;
     method = QUAT_TRANS_INTERP_NONE;
 
+    argc = parse_process_options(argc, argv, &options, &tracks, &invalid);
+    if (argc == -1)
+        exit("Option \"%s\" needs a value\n", invalid, -22)
+    else if (argc == -2)
+        exit("Invalid track list \"%s\"\n", invalid, -18)
+    else if (argc == -3)
+        exit("Invalid bake format \"%s\"\n", invalid, -20)
+    else if (argc == -4)
+        exit(cant_allocate, "tracks", -21)
+    else if (argc == -5)
+        exit("Invalid thread count \"%s\"\n", invalid, -23)
+
     if (argc < 2 || argc > 4) {
-        printf("Usage: enbrip <Enbaya file> [fps] [interpolation method]\n");
+        printf("Usage: enbrip <Enbaya file> [fps] [interpolation method]"
+            " [--tracks <list>] [--start <seconds>] [--end <seconds>] [--bake <float|int16>]\n"
+            "       [--matrix] [--threads <count>]\n");
+        printf("       enbrip encode <rtrd/raw file> [sample rate] [quantization error]"
+            " [interpolation method] [track count]\n");
+        printf("       enbrip verify <rtrd/raw file> [sample rate] [quantization error]"
+            " [interpolation method] [threads] [track count]\n");
         printf("\nInterpolation method:\n  0: None\n  1: Lerp\n  2: Slerp\n");
         printf("\nDefault fps: 30.0\nDefault interpolation method: 2 (Slerp)\n");
-        return -1;
+        printf("\nEncode/verify defaults: sample rate 30, quantization error 0.0005, 4 threads\n");
+        printf("Quantization error may be given as <rotation>:<translation>\n");
+        printf("--smallest-three stores three quaternion components where possible\n");
+        printf("--entropy rANS codes the track data sections\n");
+        printf("--predictor picks a zero, first or second order predictor per component\n");
+        printf("--restart stores the decoder state every <samples> samples for seeking and --threads,"
+            " at 57 bytes per track each\n");
+        printf("Files that are not .rtrd are read as raw quat_trans frames of [track count] tracks\n");
+        printf("--tracks decodes only the listed tracks, e.g. 0,3,5-9\n");
+        printf("--start/--end decode only that time window, frame times start at 0\n");
+        printf("--bake decodes the clip once into a random access sample table and samples that\n");
+        printf("--matrix writes row-major 3x4 matrices to a .mtx file instead of quat_trans frames\n");
+        printf("--threads decodes runs of frames in parallel, needs --restart or --bake to help\n");
+        code = -1;
+        goto End;
     }
 
     if (argc > 2)
@@ -42,78 +366,284 @@ int main(int argc, char** argv) {
     else
         method = QUAT_TRANS_INTERP_SLERP;
 
-    file_in_name_len = (int)strlen(argv[1]);
-    p = strrchr(argv[1], '.');
+    file_in_name = argv[1];
+    file_out_name = get_file_out_name(file_in_name, options.output == ENB_OUTPUT_MATRIX ? ".mtx" : ".rtrd");
+    if (!file_out_name)
+        exit(cant_allocate, "file_out", -3)
+
+    code = read_file(file_in_name, &file_in_data, &file_in_len);
+    if (code)
+        goto End;
 
-    if (p)
-        file_out_name_len = (int)(p - argv[1]);
+    code = enb_process_ex(file_in_data, &file_out_data, &file_out_len, &duration, &fps,
+        &frames, &options, (quat_trans_interp_method)method, (quat_trans_interp_method)method);
+    if (code) {
+        code -= 100;
+        goto End;
+    }
+
+    code = write_file(file_out_name, file_out_data, file_out_len);
+    if (code)
+        goto End;
+
+    printf("Processed \"%s\" to \"%s\"\n", file_in_name, file_out_name);
+    printf("Duration: %f; FPS: %f; Frames: %d\n", duration, fps, frames);
+    if (options.start > 0.0f || options.end > 0.0f)
+        printf("Window start: %f\n", options.start > 0.0f ? options.start : 0.0f);
+    if (tracks)
+        printf("Tracks: %d\n", options.num_tracks);
+    code = 0;
+
+End:
+    free(tracks);
+    free(file_out_name);
+    free(file_in_data);
+    free(file_out_data);
+    return code;
+}
+
+static int32_t encode(int argc, char** argv) {
+    char* file_in_name, * file_out_name;
+    uint8_t* file_in_data, * file_out_data;
+    int32_t code, frames, tracks, sample_rate, rotation_flips;
+    size_t file_in_len, file_out_len;
+    enb_encode_options options;
+    uint32_t signature, restart_interval;
+    int32_t method;
+    quat_trans* qt_data, * track_data;
+    int32_t* track_data_count;
+    enb_encode_context* enc_ctx;
+    clock_t start, end;
+    double_t elapsed;
+
+    file_in_name = file_out_name = (char*)0;
+    file_in_data = file_out_data = (uint8_t*)0;
+    code = frames = tracks = sample_rate = 0;
+    rotation_flips = -1;
+    file_in_len = file_out_len = 0;
+    method = QUAT_TRANS_INTERP_NONE;
+    qt_data = track_data = 0;
+    track_data_count = 0;
+    enc_ctx = 0;
+    elapsed = 0.0;
+
+    argc = parse_switches(argc, argv, &signature, &restart_interval);
+    if (argc < 2 || argc > 6) {
+        printf("Usage: enbrip encode <rtrd/raw file> [sample rate] [quantization error]"
+            " [interpolation method] [track count] [--smallest-three] [--entropy] [--predictor]\n"
+            "       [--restart <samples>]\n");
+        printf("\nInterpolation method:\n  0: None\n  1: Lerp\n  2: Slerp\n");
+        printf("\nDefault sample rate: 30\nDefault quantization error: 0.0005\n");
+        printf("Quantization error may be given as <rotation>:<translation>\n");
+        printf("Default interpolation method: 2 (Slerp)\n");
+        printf("Track count is required for raw quat_trans frame dumps\n");
+        return -1;
+    }
+
+    sample_rate = argc > 2 ? atoi(argv[2]) : 30;
+    if (sample_rate < 1)
+        sample_rate = 30;
+
+    parse_quantization(argc > 3 ? argv[3] : 0, &options);
+    options.signature = signature;
+    options.restart_interval = restart_interval;
+
+    if (argc > 4) {
+        method = atoi(argv[4]);
+        if (method < QUAT_TRANS_INTERP_NONE || method > QUAT_TRANS_INTERP_SLERP)
+            method = QUAT_TRANS_INTERP_SLERP;
+    }
     else
-        file_out_name_len = 0;
+        method = QUAT_TRANS_INTERP_SLERP;
 
-    file_in_name  = (char*)malloc(file_in_name_len + 1);
-    file_out_name = (char*)malloc(file_out_name_len + 6);
+    tracks = argc > 5 ? atoi(argv[5]) : 0;
 
-    if (!file_in_name)
-        exit(cant_allocate, "file_in", -2)
+    file_in_name = argv[1];
+    file_out_name = get_file_out_name(file_in_name, ".enb");
     if (!file_out_name)
         exit(cant_allocate, "file_out", -3)
 
-    memcpy(file_in_name, argv[1], file_in_name_len + 1);
-    memcpy(file_out_name, argv[1], file_out_name_len);
-    memcpy(file_out_name + file_out_name_len, ".rtrd", 6);
+    // A decoded foo.rtrd sits next to the foo.enb it came from, so never replace an existing file
+    if (file_exists(file_out_name))
+        exit("Output file \"%s\" already exists\n", file_out_name, -19)
 
-    file_in = fopen(file_in_name, "rb");
-    if (!file_in)
-        exit("Can't open file \"%s\" for read", file_in_name, -4)
+    code = read_frames(file_in_name, &file_in_data, &file_in_len, &qt_data, &tracks, &frames);
+    if (code)
+        goto End;
 
-    fseek(file_in, 0, SEEK_END);
-    file_in_len = ftell(file_in);
-    fseek(file_in, 0, SEEK_SET);
+    // The smallest-three and predictor variants look at whole tracks, so they need the batch encoder
+    if (options.signature & (ENB_SIGNATURE_SMALLEST_THREE | ENB_SIGNATURE_PREDICTOR)) {
+        code = get_track_data(qt_data, tracks, frames, &track_data, &track_data_count);
+        if (code)
+            goto End;
 
-    file_in_data = (uint8_t*)malloc(file_in_len);
-    if (!file_in_data)
-        exit(cant_allocate, "file_in_data", -5)
+        start = clock();
+        code = enb_encode_data_ex(track_data, track_data_count, tracks, 7,
+            qt_data[(frames - 1) * tracks].time, sample_rate, &options,
+            (quat_trans_interp_method)method, (quat_trans_interp_method)method, &file_out_data, &file_out_len);
+        end = clock();
+    }
+    else {
+        start = clock();
+        code = enb_encode_begin_ex(tracks, 7, sample_rate, &options,
+            (quat_trans_interp_method)method, (quat_trans_interp_method)method, &enc_ctx);
+        if (!code)
+            code = enb_encode_push_frames(enc_ctx, qt_data, frames);
+        if (!code)
+            code = enb_encode_finish(enc_ctx, &file_out_data, &file_out_len);
+        end = clock();
+        rotation_flips = enb_encode_get_rotation_flips(enc_ctx);
+        enb_encode_free(&enc_ctx);
+    }
 
-    if (fread(file_in_data, 1, file_in_len, file_in) != file_in_len)
-        if (fclose(file_in))
-            exit("Can't read entire file \"%s\"and close it\n", file_in_name, -6)
-        else
-            exit("Can't read entire file \"%s\"\n", file_in_name, -7)
+    if (code) {
+        code -= 100;
+        goto End;
+    }
+
+    code = write_file(file_out_name, file_out_data, file_out_len);
+    if (code)
+        goto End;
+
+    elapsed = (double_t)(end - start) / CLOCKS_PER_SEC;
+    printf("Encoded \"%s\" to \"%s\"\n", file_in_name, file_out_name);
+    printf("Tracks: %d; Frames: %d; Sample rate: %d; Quantization error: %f:%f\n", tracks, frames,
+        sample_rate, options.rotation_quantization_error, options.translation_quantization_error);
+    printf("Input size: %zu; Output size: %zu; Ratio: %.2f:1\n",
+        file_in_len, file_out_len, file_out_len ? (double_t)file_in_len / (double_t)file_out_len : 0.0);
+    printf("Encode time: %.3f ms (%.2f MB/s)\n", elapsed * 1000.0,
+        elapsed > 0.0 ? (double_t)file_in_len / elapsed / (1024.0 * 1024.0) : 0.0);
+    if (rotation_flips >= 0)
+        printf("Rotation flips: %d\n", rotation_flips);
+    code = 0;
+
+End:
+    free(track_data_count);
+    free(track_data);
+    free(file_out_name);
+    free(file_in_data);
+    free(file_out_data);
+    return code;
+}
+
+static int32_t verify(int argc, char** argv) {
+    static const char* section_name[ENB_SECTION_COUNT] = {
+        "track init i2", "track init i8", "track init i16", "track init i32",
+        "track i2", "track i4", "track i8", "track i16", "track i32",
+        "state u2", "state u8", "state u16", "state u32", "track flags",
+    };
+
+    char* file_in_name;
+    uint8_t* file_in_data;
+    int32_t code, frames, tracks, sample_rate, threads, i;
+    size_t file_in_len, extension_length;
+    float_t duration;
+    enb_encode_options options;
+    uint32_t signature, restart_interval;
+    int32_t method;
+    quat_trans* qt_data, * track_data;
+    int32_t* track_data_count;
+    enb_verify_result result;
+    enb_track_error* track_error;
+    clock_t start, end;
+
+    file_in_name = (char*)0;
+    file_in_data = (uint8_t*)0;
+    code = frames = tracks = sample_rate = threads = 0;
+    file_in_len = 0;
+    duration = 0.0f;
+    method = QUAT_TRANS_INTERP_NONE;
+    qt_data = track_data = 0;
+    track_data_count = 0;
+    memset(&result, 0, sizeof(enb_verify_result));
+
+    argc = parse_switches(argc, argv, &signature, &restart_interval);
+    if (argc < 2 || argc > 7) {
+        printf("Usage: enbrip verify <rtrd/raw file> [sample rate] [quantization error]"
+            " [interpolation method] [threads] [track count] [--smallest-three] [--entropy] [--predictor]\n"
+            "       [--restart <samples>]\n");
+        printf("\nInterpolation method:\n  0: None\n  1: Lerp\n  2: Slerp\n");
+        printf("\nDefault sample rate: 30\nDefault quantization error: 0.0005\n");
+        printf("Quantization error may be given as <rotation>:<translation>\n");
+        printf("Default interpolation method: 2 (Slerp)\nDefault threads: 4\n");
+        printf("Track count is required for raw quat_trans frame dumps\n");
+        return -1;
+    }
+
+    sample_rate = argc > 2 ? atoi(argv[2]) : 30;
+    if (sample_rate < 1)
+        sample_rate = 30;
 
-    if (fclose(file_in))
-        exit("Can't close input file \"%s\"\n", file_in_name, -8)
+    parse_quantization(argc > 3 ? argv[3] : 0, &options);
+    options.signature = signature;
+    options.restart_interval = restart_interval;
 
-    code = enb_process(file_in_data, &file_out_data, &file_out_len, &duration, &fps,
-        &frames, (quat_trans_interp_method)method, (quat_trans_interp_method)method);
+    if (argc > 4) {
+        method = atoi(argv[4]);
+        if (method < QUAT_TRANS_INTERP_NONE || method > QUAT_TRANS_INTERP_SLERP)
+            method = QUAT_TRANS_INTERP_SLERP;
+    }
+    else
+        method = QUAT_TRANS_INTERP_SLERP;
+
+    threads = argc > 5 ? atoi(argv[5]) : 4;
+    tracks = argc > 6 ? atoi(argv[6]) : 0;
+
+    file_in_name = argv[1];
+    code = read_frames(file_in_name, &file_in_data, &file_in_len, &qt_data, &tracks, &frames);
+    if (code)
+        goto End;
+
+    code = get_track_data(qt_data, tracks, frames, &track_data, &track_data_count);
+    if (code)
+        goto End;
+
+    duration = qt_data[(frames - 1) * tracks].time;
+
+    start = clock();
+    code = enb_verify_data(track_data, track_data_count, tracks, 7, duration, sample_rate,
+        &options, (quat_trans_interp_method)method, (quat_trans_interp_method)method, threads, &result);
+    end = clock();
     if (code) {
         code -= 100;
         goto End;
     }
 
-    file_out = fopen(file_out_name, "wb");
-    if (!file_out)
-        exit("Can't open file \"%s\" for write\n", file_out_name, -9)
+    printf("Verified \"%s\"\n", file_in_name);
+    printf("Tracks: %d; Frames: %d; Samples: %d; Sample rate: %d; Quantization error: %f:%f\n",
+        tracks, frames, result.sample_count, sample_rate,
+        options.rotation_quantization_error, options.translation_quantization_error);
+    printf("Input size: %zu; Output size: %zu; Ratio: %.2f:1; CPU time: %.3f ms\n",
+        file_in_len, result.data_len, result.data_len ? (double_t)file_in_len / (double_t)result.data_len : 0.0,
+        (double_t)(end - start) * 1000.0 / CLOCKS_PER_SEC);
+    printf("Rotation flips: %d\n", result.rotation_flips);
 
-    if (fwrite(file_out_data, 1, file_out_len, file_out) != file_out_len)
-        if (fclose(file_out))
-            exit("Can't write entire file \"%s\" and close it\n", file_out_name, -10)
-        else
-            exit("Can't write entire file \"%s\"\n", file_out_name, -11)
+    printf("\nSection sizes:\n");
+    for (i = 0; i < ENB_SECTION_COUNT; i++)
+        printf("  %-16s%10u\n", section_name[i], result.section_length[i]);
 
-    if (fclose(file_out))
-        exit("Can't close output file \"%s\"\n", file_out_name, -12)
+    extension_length = result.data_len - 0x50;
+    for (i = 0; i < ENB_SECTION_COUNT; i++)
+        extension_length -= result.section_length[i];
+    if (extension_length)
+        printf("  %-16s%10zu\n", "extensions", extension_length);
 
-    printf("Processed \"%s\" to \"%s\"\n", file_in_name, file_out_name);
-    printf("Duration: %f; FPS: %f; Frames: %d\n", duration, fps, frames);
+    printf("\nTrack   rot max (deg)  rot rms (deg)   trans max      trans rms\n");
+    for (i = 0; i < tracks; i++) {
+        track_error = &result.track_error[i];
+        printf("%5d   %-14.6f %-14.6f  %-14.8f %-14.8f\n", i,
+            track_error->rotation_max_error * (180.0 / M_PI), track_error->rotation_rms_error * (180.0 / M_PI),
+            track_error->translation_max_error, track_error->translation_rms_error);
+    }
+    printf("  All   %-14.6f %-14.6f  %-14.8f %-14.8f\n",
+        result.error.rotation_max_error * (180.0 / M_PI), result.error.rotation_rms_error * (180.0 / M_PI),
+        result.error.translation_max_error, result.error.translation_rms_error);
     code = 0;
 
 End:
-    free(file_in_name);
-    free(file_out_name);
+    enb_verify_free(&result);
+    free(track_data_count);
+    free(track_data);
     free(file_in_data);
-    free(file_out_data);
-    file_in = 0;
-    file_out = 0;
-    p = 0;
     return code;
 }
@@ -7,6 +7,7 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
 #include "enbaya.h"
 
 #define exit(message, val, err_code) { printf(message, val); code = err_code; goto End; }